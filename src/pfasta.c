@@ -19,16 +19,42 @@
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
 #include "pfasta.h"
 
-#ifdef __SSE2__
-#include <emmintrin.h>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define PF_DISPATCH 1
+#else
+#define PF_DISPATCH 0
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup) && \
+    !defined(PFASTA_NO_URING)
+#define PF_URING 1
+#else
+#define PF_URING 0
 #endif
 
 #if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
@@ -58,12 +84,53 @@ void *pfasta_reallocarray(void *ptr, size_t nmemb, size_t size);
 #define LIKELY(X) __builtin_expect((intptr_t)(X), 1)
 #define UNLIKELY(X) __builtin_expect((intptr_t)(X), 0)
 
+/** Static tracepoints for bpftrace, perf and the like. They are compiled in
+ * with WITH_SDT only, and then cost a single nop while nobody is tracing.
+ */
+#ifdef WITH_SDT
+#include <sys/sdt.h>
+#define PF_PROBE2(NAME, A, B) DTRACE_PROBE2(pfasta, NAME, A, B)
+#define PF_PROBE3(NAME, A, B, C) DTRACE_PROBE3(pfasta, NAME, A, B, C)
+#else
+#define PF_PROBE2(NAME, A, B) ((void)0)
+#define PF_PROBE3(NAME, A, B, C) ((void)0)
+#endif
+
 enum { NO_ERROR, E_EOF, E_ERROR, E_ERRNO, E_BUBBLE, E_STR, E_STR_CONST };
 
+/** The parser either reads the input in chunks of BUFFER_SIZE bytes into its
+ * own buffer, walks a memory-mapping of the whole file, walks a piece of
+ * memory owned by someone else, or walks blocks of decompressed input.
+ */
+enum {
+	BACKEND_READ,
+	BACKEND_MMAP,
+	BACKEND_MEMORY,
+	BACKEND_GZIP,
+	BACKEND_READAHEAD,
+	BACKEND_URING
+};
+
+/** @brief Copy the message of errno into the error buffer. The GNU variant
+ * of strerror_r may return a static string instead of filling the buffer.
+ */
+static char *errstr_errno(void) {
+#if defined(_GNU_SOURCE) && defined(__GLIBC__)
+	const char *message =
+	    strerror_r(errno, errstr_buffer, PF_ERROR_STRING_LENGTH);
+	if (message != errstr_buffer) {
+		(void)snprintf(errstr_buffer, PF_ERROR_STRING_LENGTH, "%s", message);
+	}
+#else
+	(void)strerror_r(errno, errstr_buffer, PF_ERROR_STRING_LENGTH);
+#endif
+	return errstr_buffer;
+}
+
 #define PF_FAIL_ERRNO(PP)                                                      \
 	do {                                                                       \
-		(void)strerror_r(errno, errstr_buffer, PF_ERROR_STRING_LENGTH);        \
-		(PP)->errstr = errstr_buffer;                                          \
+		(PP)->errstr = errstr_errno();                                         \
+		PF_PROBE2(error, (PP), (PP)->errstr);                                  \
 		return_code = E_ERRNO;                                                 \
 		goto cleanup;                                                          \
 	} while (0)
@@ -87,6 +154,7 @@ enum { NO_ERROR, E_EOF, E_ERROR, E_ERRNO, E_BUBBLE, E_STR, E_STR_CONST };
 #define PF_FAIL_STR_CONST(PP, STR)                                             \
 	do {                                                                       \
 		(PP)->errstr = (STR);                                                  \
+		PF_PROBE2(error, (PP), (PP)->errstr);                                  \
 		return_code = E_STR_CONST;                                             \
 		goto cleanup;                                                          \
 	} while (0)
@@ -95,13 +163,17 @@ enum { NO_ERROR, E_EOF, E_ERROR, E_ERRNO, E_BUBBLE, E_STR, E_STR_CONST };
 	do {                                                                       \
 		(void)snprintf(errstr_buffer, PF_ERROR_STRING_LENGTH, __VA_ARGS__);    \
 		(PP)->errstr = errstr_buffer;                                          \
+		PF_PROBE2(error, (PP), (PP)->errstr);                                  \
 		return_code = E_STR;                                                   \
 		goto cleanup;                                                          \
 	} while (0)
 
-int pfasta_read_name(struct pfasta_parser *pp, struct pfasta_record *pr);
-int pfasta_read_comment(struct pfasta_parser *pp, struct pfasta_record *pr);
-int pfasta_read_sequence(struct pfasta_parser *pp, struct pfasta_record *pr);
+typedef struct pfasta_dynstr dynstr;
+
+int pfasta_read_name(struct pfasta_parser *pp, dynstr *name);
+int pfasta_read_comment(struct pfasta_parser *pp, dynstr *comment,
+                        int *has_comment);
+int pfasta_read_sequence(struct pfasta_parser *pp, dynstr *sequence);
 
 static inline char *buffer_begin(struct pfasta_parser *pp);
 static inline char *buffer_end(struct pfasta_parser *pp);
@@ -110,14 +182,36 @@ static inline int buffer_is_empty(const struct pfasta_parser *pp);
 static inline int buffer_is_eof(const struct pfasta_parser *pp);
 static inline int buffer_peek(struct pfasta_parser *pp);
 static inline int buffer_read(struct pfasta_parser *pp);
+static inline int buffer_is_stable(const struct pfasta_parser *pp);
+static inline void structure_invalidate(struct pfasta_structure *st);
+static int buffer_map(struct pfasta_parser *pp);
+static int buffer_is_gzip(const struct pfasta_parser *pp);
+static int inflate_init(struct pfasta_parser *pp);
+static ssize_t inflate_next(struct pfasta_parser *pp);
+static void inflate_free(struct pfasta_inflate *inf);
+static int bgzf_record_start(struct pfasta_inflate *inf);
+static int readahead_init(struct pfasta_parser *pp);
+static ssize_t readahead_next(struct pfasta_parser *pp);
+static void readahead_free(struct pfasta_readahead *ra);
+static ssize_t uring_next(struct pfasta_parser *pp);
+static void uring_release(struct pfasta_uring_slot *slot);
+static int uring_is_whole(const struct pfasta_uring_slot *slot);
+static int chunk_read(struct pfasta_parser *pp, char *buffer, size_t size,
+                      size_t *count);
+static int sequence_append(struct pfasta_parser *pp, dynstr *sequence,
+                           const char *str, size_t length, size_t line_number);
+static int chunk_skip(struct pfasta_parser *pp, size_t *count);
 
-typedef struct dynstr {
-	char *str;
-	size_t capacity, count;
-} dynstr;
+#define DYNSTR_INITIAL_CAPACITY 61
 
 static inline char *dynstr_move(dynstr *ds);
 static inline int dynstr_init(dynstr *ds, struct pfasta_parser *pp);
+static inline void dynstr_reset(dynstr *ds, int borrow);
+static inline int dynstr_reserve(dynstr *ds, size_t required,
+                                 struct pfasta_parser *pp);
+static int dynstr_unborrow(dynstr *ds, size_t extra, struct pfasta_parser *pp);
+static inline struct pfasta_span dynstr_span(dynstr *ds);
+static inline char *dynstr_terminate(dynstr *ds);
 static inline size_t dynstr_len(const dynstr *ds);
 static inline void dynstr_free(dynstr *ds);
 static inline int dynstr_append(dynstr *ds, const char *str, size_t length,
@@ -128,26 +222,107 @@ static inline int my_isspace(int c) {
 	return (c >= '\t' && c <= '\r') || (c == ' ');
 }
 
+/** @brief A monotonic time stamp in nanoseconds, for the statistics. */
+static uint64_t stats_clock(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
 const char *pfasta_version(void) { return VERSION; }
 
 int buffer_init(struct pfasta_parser *pp) {
 	int return_code = 0;
+	int check;
 
-	pp->buffer = malloc(BUFFER_SIZE);
-	if (!pp->buffer) PF_FAIL_ERRNO(pp);
+	if (!buffer_map(pp)) {
+		pp->backend = BACKEND_READ;
+		pp->buffer = malloc(BUFFER_SIZE);
+		if (!pp->buffer) PF_FAIL_ERRNO(pp);
 
-	int check = buffer_read(pp);
-	PF_FAIL_BUBBLE_CHECK(pp, check);
+		check = buffer_read(pp);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+	}
+
+	// Compressed input is recognized by its magic bytes.
+	if (buffer_is_gzip(pp)) {
+		check = inflate_init(pp);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+	}
 
 cleanup:
 	return return_code;
 }
 
+/** @brief Try to map the input file into memory.
+ *
+ * This only works for non-empty regular files. Everything else (pipes,
+ * terminals, sockets) and any failure falls back to reading.
+ *
+ * @returns 1 iff the file is mapped and the buffer pointers are set up.
+ */
+static int buffer_map(struct pfasta_parser *pp) {
+	struct stat st;
+	if (fstat(pp->file_descriptor, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+
+	// Respect data the caller may have consumed already.
+	off_t offset = lseek(pp->file_descriptor, 0, SEEK_CUR);
+	if (offset < 0 || offset >= st.st_size) return 0;
+	if ((uintmax_t)st.st_size > SIZE_MAX) return 0;
+
+	size_t length = st.st_size;
+	void *mapping =
+	    mmap(NULL, length, PROT_READ, MAP_PRIVATE, pp->file_descriptor, 0);
+	if (mapping == MAP_FAILED) return 0;
+
+#ifdef MADV_SEQUENTIAL
+	(void)madvise(mapping, length, MADV_SEQUENTIAL);
+#endif
+
+	pp->backend = BACKEND_MMAP;
+	pp->buffer = mapping;
+	pp->mapped_length = length;
+	pp->read_ptr = pp->buffer + offset;
+	pp->fill_ptr = pp->buffer + length;
+	pp->stats.bytes_read += length - offset;
+	return 1;
+}
+
 int buffer_read(struct pfasta_parser *pp) {
 	int return_code = NO_ERROR;
-	ssize_t count = read(pp->file_descriptor, pp->buffer, BUFFER_SIZE);
 
-	if (UNLIKELY(count < 0)) PF_FAIL_ERRNO(pp);
+	if (buffer_is_stable(pp)) {
+		// The whole input is visible at once; running out of data means EOF.
+		pp->fill_ptr = pp->buffer;
+		pp->read_ptr = pp->buffer + 1;
+		pp->errstr = "EOF (maybe error)"; // enable bubbling
+		return E_EOF;
+	}
+
+	// A refill right between two records does not split one.
+	int boundary = !pp->fill_ptr || pp->fill_ptr <= pp->buffer ||
+	               pp->fill_ptr[-1] == '\n';
+
+	structure_invalidate(pp->structure);
+	PF_PROBE2(refill_start, pp, pp->backend);
+	uint64_t start = stats_clock();
+	ssize_t count;
+	if (pp->backend == BACKEND_GZIP) {
+		count = inflate_next(pp);
+	} else if (pp->backend == BACKEND_READAHEAD) {
+		count = readahead_next(pp);
+	} else if (pp->backend == BACKEND_URING) {
+		count = uring_next(pp);
+	} else {
+		count = read(pp->file_descriptor, pp->buffer, BUFFER_SIZE);
+	}
+	pp->stats.io_nanoseconds += stats_clock() - start;
+	PF_PROBE2(refill_end, pp, count);
+
+	if (UNLIKELY(count < 0)) {
+		PF_FAIL_BUBBLE(pp); // decompression errors come with a message
+		PF_FAIL_ERRNO(pp);
+	}
 	if (UNLIKELY(count == 0)) { // EOF
 		pp->fill_ptr = pp->buffer;
 		pp->read_ptr = pp->buffer + 1;
@@ -158,6 +333,12 @@ int buffer_read(struct pfasta_parser *pp) {
 	pp->read_ptr = pp->buffer;
 	pp->fill_ptr = pp->buffer + count;
 
+	pp->stats.reads++;
+	pp->stats.bytes_read += count;
+	if (pp->stats.records && !(boundary && pp->buffer[0] == '>')) {
+		pp->stats.mid_record_refills++;
+	}
+
 cleanup:
 	return return_code;
 }
@@ -193,383 +374,5097 @@ int buffer_is_eof(const struct pfasta_parser *pp) {
 	return pp->read_ptr > pp->fill_ptr;
 }
 
-char *find_first_space(const char *begin, const char *end) {
-	size_t offset = 0;
-	size_t length = end - begin;
+/** @brief Returns 1 iff the data stays in place until the parser is freed. */
+int buffer_is_stable(const struct pfasta_parser *pp) {
+	return pp->backend == BACKEND_MMAP || pp->backend == BACKEND_MEMORY ||
+	       (pp->backend == BACKEND_URING && uring_is_whole(pp->uring));
+}
 
-#ifdef __SSE2__
+/* Compressed input. Gzip files are decompressed on background threads into a
+ * ring of blocks, which the parser then walks just like its own buffer. BGZF
+ * files consist of independent gzip members of at most 64 KiB each, so their
+ * blocks are inflated in parallel. Any other gzip stream is inflated
+ * sequentially, but still overlaps with parsing.
+ */
 
-	typedef __m128i vec_type;
-	static const size_t vec_size = sizeof(vec_type);
+#define INFLATE_BLOCK_SIZE 65536
+#define INFLATE_SLOTS 16
+#define INFLATE_MAX_THREADS 4
+#define BGZF_HEADER_SIZE 18
 
-	const vec_type all_tab = _mm_set1_epi8('\t' - 1);
-	const vec_type all_carriage = _mm_set1_epi8('\r' + 1);
-	const vec_type all_space = _mm_set1_epi8(' ');
+enum { SLOT_FREE, SLOT_BUSY, SLOT_READY };
 
-	size_t vec_offset = 0;
-	size_t vec_length = (end - begin) / vec_size;
+struct inflate_slot {
+	int state;
+	size_t sequence;
+	size_t length;
+	unsigned char *data;
+	unsigned char *compressed;
+	size_t compressed_length;
+	size_t compressed_offset;
+};
 
-	for (; vec_offset < vec_length; vec_offset++) {
-		vec_type chunk;
-		memcpy(&chunk, begin + vec_offset * vec_size, vec_size);
+/* Where a BGZF block starts, in the compressed and the decompressed data. The
+ * list of all blocks is what a .gzi file stores.
+ */
+struct pfasta_bgzf_block {
+	size_t compressed, uncompressed;
+};
 
-		// isspace: \t <= char <= \r || char == space
-		vec_type v1 = _mm_cmplt_epi8(all_tab, chunk);
-		vec_type v2 = _mm_cmplt_epi8(chunk, all_carriage);
-		vec_type v3 = _mm_cmpeq_epi8(chunk, all_space);
+struct pfasta_inflate {
+	// The compressed input: first the pending bytes, then the rest of the file.
+	const unsigned char *pending;
+	size_t pending_length;
+	int from_file;
+	int file_descriptor;
+	char *mapping, *read_buffer;
+	size_t mapped_length;
+	size_t consumed; // compressed bytes read so far
 
-		unsigned int vmask = (_mm_movemask_epi8(v1) & _mm_movemask_epi8(v2)) |
-		                     _mm_movemask_epi8(v3);
+	int bgzf;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	pthread_t threads[INFLATE_MAX_THREADS];
+	size_t thread_count;
+	int stop;
 
-		if (UNLIKELY(vmask)) {
-			offset += __builtin_ctz(vmask);
-			offset += vec_offset * vec_size;
-			return (char *)begin + offset;
-		}
+	struct inflate_slot slots[INFLATE_SLOTS];
+	struct inflate_slot *current; // the slot the parser is walking
+	size_t next_sequence;         // next block to be read
+	size_t next_delivery;         // next block to hand to the parser
+	size_t total;                 // number of blocks, once known
+	size_t failed_at;             // first broken block
+	char message[PF_ERROR_STRING_LENGTH];
+
+	// Optionally, the delivered BGZF blocks are recorded for a .gzi index.
+	int record;
+	size_t delivered; // decompressed bytes handed to the parser so far
+	struct pfasta_bgzf_block *blocks;
+	size_t block_count, block_capacity;
+};
+
+/** @brief Returns 1 iff the buffer starts with the gzip magic bytes. */
+static int buffer_is_gzip(const struct pfasta_parser *pp) {
+	return pp->fill_ptr - pp->read_ptr >= 2 &&
+	       (unsigned char)pp->read_ptr[0] == 0x1f &&
+	       (unsigned char)pp->read_ptr[1] == 0x8b;
+}
+
+#ifdef WITH_ZLIB
+
+/** @brief Read up to `length` bytes of compressed input.
+ *
+ * @returns the number of bytes read, which is less than `length` only at the
+ * end of the input, or -1 on error.
+ */
+static ssize_t inflate_input(struct pfasta_inflate *inf, unsigned char *dest,
+                             size_t length) {
+	size_t done = inf->pending_length < length ? inf->pending_length : length;
+	memcpy(dest, inf->pending, done);
+	inf->pending += done;
+	inf->pending_length -= done;
+
+	while (done < length && inf->from_file) {
+		ssize_t count = read(inf->file_descriptor, dest + done, length - done);
+		if (count < 0 && errno == EINTR) continue;
+		if (count < 0) return -1;
+		if (count == 0) inf->from_file = 0;
+		done += count;
 	}
 
-	offset += vec_offset * vec_size;
-#endif
+	inf->consumed += done;
+	return done;
+}
 
-	for (; offset < length; offset++) {
-		if (my_isspace(begin[offset])) break;
+/** @brief Record the first failure. Must hold the lock. */
+static void inflate_fail(struct pfasta_inflate *inf, size_t sequence,
+                         const char *message) {
+	if (sequence < inf->failed_at) {
+		inf->failed_at = sequence;
+		(void)snprintf(inf->message, sizeof(inf->message), "%s", message);
 	}
-	return (char *)begin + offset;
+	pthread_cond_broadcast(&inf->changed);
 }
 
-char *find_first_not_space(const char *begin, const char *end) {
-	size_t offset = 0;
-	size_t length = end - begin;
+/** @brief Claim the next free slot in order. Must hold the lock.
+ *
+ * @returns NULL iff the decompression is about to stop.
+ */
+static struct inflate_slot *inflate_claim(struct pfasta_inflate *inf) {
+	while (1) {
+		if (inf->stop || inf->next_sequence >= inf->total ||
+		    inf->next_sequence >= inf->failed_at) {
+			return NULL;
+		}
 
-	for (; offset < length; offset++) {
-		if (!my_isspace(begin[offset])) break;
+		struct inflate_slot *slot =
+		    &inf->slots[inf->next_sequence % INFLATE_SLOTS];
+		if (slot->state == SLOT_FREE) {
+			slot->state = SLOT_BUSY;
+			slot->sequence = inf->next_sequence++;
+			return slot;
+		}
+
+		pthread_cond_wait(&inf->changed, &inf->lock);
 	}
-	return (char *)begin + offset;
 }
 
-size_t count_newlines(const char *begin, const char *end) {
-	size_t offset = 0;
-	size_t length = end - begin;
-	size_t newlines = 0;
+/** @brief Mark a slot as ready for the parser. Must hold the lock. */
+static void inflate_publish(struct pfasta_inflate *inf,
+                            struct inflate_slot *slot) {
+	slot->state = SLOT_READY;
+	pthread_cond_broadcast(&inf->changed);
+}
 
-	for (; offset < length; offset++) {
-		if (begin[offset] == '\n') newlines++;
+/** @brief Get the size of a BGZF block from its header.
+ *
+ * @returns the size of the whole block, or 0 if the header is malformed.
+ */
+static size_t bgzf_block_size(const unsigned char *header) {
+	if (header[0] != 0x1f || header[1] != 0x8b || header[12] != 'B' ||
+	    header[13] != 'C') {
+		return 0;
 	}
 
-	return newlines;
+	size_t block_size = (header[16] | (size_t)header[17] << 8) + 1;
+	return block_size < BGZF_HEADER_SIZE + 8 ? 0 : block_size;
 }
 
-static int copy_word(struct pfasta_parser *pp, dynstr *target) {
-	int return_code = 0;
+/** @brief Inflate a complete BGZF block into `dest`, which has room for
+ * INFLATE_BLOCK_SIZE bytes.
+ *
+ * @returns the number of decompressed bytes, or -1 if the block is corrupt.
+ */
+static ssize_t bgzf_inflate(z_stream *zs, const unsigned char *block,
+                            size_t block_size, unsigned char *dest) {
+	inflateReset(zs);
+	zs->next_in = (unsigned char *)block;
+	zs->avail_in = block_size;
+	zs->next_out = dest;
+	zs->avail_out = INFLATE_BLOCK_SIZE;
+	int status = inflate(zs, Z_FINISH);
+	if (status != Z_STREAM_END) return -1;
+	return INFLATE_BLOCK_SIZE - zs->avail_out;
+}
 
-	int c;
-	while (c = buffer_peek(pp), c != EOF && LIKELY(!my_isspace(c))) {
-		char *end_of_word = find_first_space(buffer_begin(pp), buffer_end(pp));
-		size_t word_length = end_of_word - buffer_begin(pp);
+/** @brief Read the next BGZF block into the slot. Must hold the lock.
+ *
+ * @returns 1 iff a block was read, 0 at the end of the input, -1 on error.
+ */
+static int bgzf_read_block(struct pfasta_inflate *inf,
+                           struct inflate_slot *slot) {
+	unsigned char *header = slot->compressed;
+	slot->compressed_offset = inf->consumed;
+	ssize_t count = inflate_input(inf, header, BGZF_HEADER_SIZE);
+	if (count == 0) return 0;
+	if (count != BGZF_HEADER_SIZE) return -1;
 
-		assert(word_length > 0);
+	size_t block_size = bgzf_block_size(header);
+	if (!block_size) return -1;
 
-		int check = dynstr_append(target, buffer_begin(pp), word_length, pp);
-		PF_FAIL_BUBBLE_CHECK(pp, check);
+	size_t rest = block_size - BGZF_HEADER_SIZE;
+	count = inflate_input(inf, header + BGZF_HEADER_SIZE, rest);
+	if (count < 0 || (size_t)count != rest) return -1;
 
-		check = buffer_advance(pp, word_length);
-		PF_FAIL_BUBBLE_CHECK(pp, check);
+	slot->compressed_length = block_size;
+	return 1;
+}
+
+static void *bgzf_work(void *arg) {
+	struct pfasta_inflate *inf = arg;
+	z_stream zs = {0};
+	int ok = inflateInit2(&zs, 15 + 16) == Z_OK;
+
+	pthread_mutex_lock(&inf->lock);
+	if (!ok) inflate_fail(inf, inf->next_sequence, "Out of memory.");
+
+	while (ok) {
+		struct inflate_slot *slot = inflate_claim(inf);
+		if (!slot) break;
+
+		// Reading happens under the lock, so that blocks stay in order.
+		int check = bgzf_read_block(inf, slot);
+		if (check <= 0) {
+			slot->state = SLOT_FREE;
+			inf->next_sequence--;
+			if (check == 0) {
+				inf->total = slot->sequence;
+				pthread_cond_broadcast(&inf->changed);
+			} else {
+				inflate_fail(inf, slot->sequence, "Malformed BGZF block.");
+			}
+			break;
+		}
+		pthread_mutex_unlock(&inf->lock);
+
+		ssize_t length = bgzf_inflate(&zs, slot->compressed,
+		                              slot->compressed_length, slot->data);
+
+		pthread_mutex_lock(&inf->lock);
+		if (length < 0) {
+			inflate_fail(inf, slot->sequence, "Corrupt compressed data.");
+			break;
+		}
+		slot->length = length;
+		inflate_publish(inf, slot);
 	}
+	pthread_mutex_unlock(&inf->lock);
 
-cleanup:
-	return return_code;
+	inflateEnd(&zs);
+	return NULL;
 }
 
-static int skip_whitespace(struct pfasta_parser *pp) {
-	int return_code = 0;
+static void *gzip_work(void *arg) {
+	struct pfasta_inflate *inf = arg;
+	unsigned char input[INFLATE_BLOCK_SIZE];
+	z_stream zs = {0};
+	int ok = inflateInit2(&zs, 15 + 16) == Z_OK;
+	int input_done = 0, in_member = 0;
 
-	while (my_isspace(buffer_peek(pp))) {
-		char *split = find_first_not_space(buffer_begin(pp), buffer_end(pp));
+	pthread_mutex_lock(&inf->lock);
+	if (!ok) inflate_fail(inf, inf->next_sequence, "Out of memory.");
 
-		// advance may clear the buffer. So count first …
-		size_t newlines = count_newlines(buffer_begin(pp), split);
-		int check = buffer_advance(pp, split - buffer_begin(pp));
-		PF_FAIL_BUBBLE_CHECK(pp, check);
+	while (ok) {
+		struct inflate_slot *slot = inflate_claim(inf);
+		if (!slot) break;
+		pthread_mutex_unlock(&inf->lock);
 
-		// … and then increase the counter.
-		pp->line_number += newlines;
+		// Being the only worker, this thread may read without the lock.
+		const char *error = NULL;
+		zs.next_out = slot->data;
+		zs.avail_out = INFLATE_BLOCK_SIZE;
+		while (zs.avail_out && !error) {
+			if (zs.avail_in == 0 && !input_done) {
+				ssize_t count = inflate_input(inf, input, sizeof(input));
+				if (count < 0) error = "Reading compressed input failed.";
+				if (count <= 0) input_done = 1;
+				zs.next_in = input;
+				zs.avail_in = count > 0 ? count : 0;
+			}
+			if (zs.avail_in == 0 && input_done) {
+				if (in_member) error = "Unexpected end of compressed data.";
+				break;
+			}
+
+			in_member = 1;
+			int status = inflate(&zs, Z_NO_FLUSH);
+			if (status == Z_STREAM_END) {
+				// Further gzip members may follow.
+				inflateReset(&zs);
+				in_member = 0;
+			} else if (status != Z_OK && status != Z_BUF_ERROR) {
+				error = "Corrupt compressed data.";
+			}
+		}
+		slot->length = INFLATE_BLOCK_SIZE - zs.avail_out;
+
+		pthread_mutex_lock(&inf->lock);
+		if (error) {
+			// Hand out what could be decompressed, then fail.
+			if (slot->length) inflate_publish(inf, slot);
+			inflate_fail(inf, slot->sequence + (slot->length != 0), error);
+			break;
+		}
+		if (slot->length == 0) {
+			slot->state = SLOT_FREE;
+			inf->next_sequence--;
+			inf->total = slot->sequence;
+			pthread_cond_broadcast(&inf->changed);
+			break;
+		}
+		inflate_publish(inf, slot);
 	}
+	pthread_mutex_unlock(&inf->lock);
 
-cleanup:
-	return return_code;
+	inflateEnd(&zs);
+	return NULL;
 }
 
-struct pfasta_parser pfasta_init(int file_descriptor) {
+/** @brief Turn a parser that found compressed data into one that parses the
+ * decompressed data. The compressed bytes seen so far are taken over.
+ */
+static int inflate_init(struct pfasta_parser *pp) {
 	int return_code = 0;
-	struct pfasta_parser pp = {0};
-	pp.line_number = 1;
 
-	pp.file_descriptor = file_descriptor;
-	int check = buffer_init(&pp);
-	if (check && check != E_EOF) PF_FAIL_BUBBLE_CHECK(&pp, check);
+	struct pfasta_inflate *inf = calloc(1, sizeof(*inf));
+	if (!inf) PF_FAIL_ERRNO(pp);
+	pthread_mutex_init(&inf->lock, NULL);
+	pthread_cond_init(&inf->changed, NULL);
+
+	inf->file_descriptor = pp->file_descriptor;
+	inf->pending = (const unsigned char *)pp->read_ptr;
+	inf->pending_length = pp->fill_ptr - pp->read_ptr;
+	if (pp->backend == BACKEND_MMAP) {
+		inf->mapping = pp->buffer;
+		inf->mapped_length = pp->mapped_length;
+	} else {
+		inf->read_buffer = pp->buffer;
+		inf->from_file = 1;
+	}
+
+	pp->backend = BACKEND_GZIP;
+	pp->inflate = inf;
+	pp->buffer = pp->read_ptr = pp->fill_ptr = NULL;
+	pp->mapped_length = 0;
 
-	if (buffer_is_empty(&pp) || buffer_is_eof(&pp)) {
-		PF_FAIL_STR(&pp, "File is empty.");
+	inf->total = inf->failed_at = SIZE_MAX;
+	for (size_t i = 0; i < INFLATE_SLOTS; i++) {
+		inf->slots[i].data = malloc(2 * INFLATE_BLOCK_SIZE);
+		if (!inf->slots[i].data) PF_FAIL_ERRNO(pp);
+		inf->slots[i].compressed = inf->slots[i].data + INFLATE_BLOCK_SIZE;
 	}
+	pp->buffer = (char *)inf->slots[0].data;
 
-	if (buffer_peek(&pp) != '>') {
-		PF_FAIL_STR(&pp, "File must start with '>'.");
+	// The BGZF header has a fixed layout with an extra field named "BC".
+	const unsigned char *header = inf->pending;
+	inf->bgzf = inf->pending_length >= BGZF_HEADER_SIZE && header[2] == 8 &&
+	            (header[3] & 4) && header[12] == 'B' && header[13] == 'C';
+
+	size_t threads = 1;
+	if (inf->bgzf) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus < 1 ? 1 : cpus;
+		if (threads > INFLATE_MAX_THREADS) threads = INFLATE_MAX_THREADS;
+	}
+
+	for (size_t i = 0; i < threads; i++) {
+		int check = pthread_create(&inf->threads[i], NULL,
+		                           inf->bgzf ? bgzf_work : gzip_work, inf);
+		if (check) {
+			errno = check;
+			PF_FAIL_ERRNO(pp);
+		}
+		inf->thread_count++;
+	}
+
+	// Make the first block available, just like the first read would. From
+	// here on, the statistics count decompressed bytes.
+	pp->stats.bytes_read = pp->stats.reads = 0;
+	uint64_t start = stats_clock();
+	ssize_t count = inflate_next(pp);
+	pp->stats.io_nanoseconds += stats_clock() - start;
+	if (count < 0) return_code = E_BUBBLE;
+	if (count == 0) {
+		pp->fill_ptr = pp->buffer;
+		pp->read_ptr = pp->buffer + 1;
+		pp->errstr = "EOF (maybe error)"; // enable bubbling
+		return_code = E_EOF;
+	}
+	if (count > 0) {
+		pp->read_ptr = pp->buffer;
+		pp->fill_ptr = pp->buffer + count;
+		pp->stats.reads++;
+		pp->stats.bytes_read += count;
 	}
 
 cleanup:
-	// free buffer if necessary
-	if (return_code) {
-		pfasta_free(&pp);
+	return return_code;
+}
+
+/** @brief Append a block to the list of recorded blocks. */
+static int bgzf_record(struct pfasta_inflate *inf,
+                       const struct inflate_slot *slot) {
+	if (inf->block_count == inf->block_capacity) {
+		size_t capacity = inf->block_capacity * 2 + 64;
+		struct pfasta_bgzf_block *blocks =
+		    pfasta_reallocarray(inf->blocks, capacity, sizeof(*blocks));
+		if (!blocks) return -1;
+		inf->blocks = blocks;
+		inf->block_capacity = capacity;
 	}
-	pp.done = return_code || buffer_is_eof(&pp);
-	return pp;
+
+	inf->blocks[inf->block_count++] = (struct pfasta_bgzf_block){
+	    .compressed = slot->compressed_offset, .uncompressed = inf->delivered};
+	return 0;
 }
 
-struct pfasta_record pfasta_read(struct pfasta_parser *pp) {
-	int return_code = 0;
-	struct pfasta_record pr = {0};
+/** @brief Start recording the blocks of a BGZF file, beginning with the one
+ * the parser is walking.
+ *
+ * @returns 0 iff successful.
+ */
+static int bgzf_record_start(struct pfasta_inflate *inf) {
+	int check = 0;
+	pthread_mutex_lock(&inf->lock);
+	inf->record = 1;
+	if (inf->current) {
+		inf->delivered -= inf->current->length;
+		check = bgzf_record(inf, inf->current);
+		inf->delivered += inf->current->length;
+	}
+	pthread_mutex_unlock(&inf->lock);
+	return check;
+}
 
-	int check = pfasta_read_name(pp, &pr);
-	PF_FAIL_BUBBLE_CHECK(pp, check);
+/** @brief Hand the next decompressed block to the parser.
+ *
+ * @returns the number of bytes in the block, 0 at the end of the input, or -1
+ * on error.
+ */
+static ssize_t inflate_next(struct pfasta_parser *pp) {
+	struct pfasta_inflate *inf = pp->inflate;
+	ssize_t count = 0;
 
-	check = pfasta_read_comment(pp, &pr);
-	PF_FAIL_BUBBLE_CHECK(pp, check);
+	pthread_mutex_lock(&inf->lock);
+	if (inf->current) {
+		inf->current->state = SLOT_FREE;
+		inf->current = NULL;
+		inf->next_delivery++;
+		pthread_cond_broadcast(&inf->changed);
+	}
 
-	check = pfasta_read_sequence(pp, &pr);
-	PF_FAIL_BUBBLE_CHECK(pp, check);
+	while (1) {
+		struct inflate_slot *slot =
+		    &inf->slots[inf->next_delivery % INFLATE_SLOTS];
+		if (slot->state == SLOT_READY &&
+		    slot->sequence == inf->next_delivery) {
+			if (slot->length == 0) { // e.g. the BGZF end-of-file marker
+				slot->state = SLOT_FREE;
+				inf->next_delivery++;
+				pthread_cond_broadcast(&inf->changed);
+				continue;
+			}
 
-cleanup:
-	if (return_code) {
-		pfasta_record_free(&pr);
-		pfasta_free(pp);
+			if (inf->record && bgzf_record(inf, slot)) {
+				(void)snprintf(errstr_buffer, PF_ERROR_STRING_LENGTH, "%s",
+				               "Out of memory.");
+				pp->errstr = errstr_buffer;
+				PF_PROBE2(error, pp, pp->errstr);
+				count = -1;
+				break;
+			}
+
+			inf->current = slot;
+			inf->delivered += slot->length;
+			pp->buffer = (char *)slot->data;
+			count = slot->length;
+			break;
+		}
+
+		if (inf->next_delivery >= inf->failed_at) {
+			(void)snprintf(errstr_buffer, PF_ERROR_STRING_LENGTH, "%s",
+			               inf->message);
+			pp->errstr = errstr_buffer;
+			PF_PROBE2(error, pp, pp->errstr);
+			count = -1;
+			break;
+		}
+
+		if (inf->next_delivery >= inf->total) break;
+
+		pthread_cond_wait(&inf->changed, &inf->lock);
 	}
-	pp->done = return_code || buffer_is_eof(pp);
-	return pr;
+	pthread_mutex_unlock(&inf->lock);
+
+	return count;
 }
 
-int pfasta_read_name(struct pfasta_parser *pp, struct pfasta_record *pr) {
-	int return_code = 0;
+static void inflate_free(struct pfasta_inflate *inf) {
+	if (!inf) return;
 
-	dynstr name;
-	dynstr_init(&name, pp);
-	PF_FAIL_BUBBLE(pp);
+	if (inf->thread_count) {
+		pthread_mutex_lock(&inf->lock);
+		inf->stop = 1;
+		pthread_cond_broadcast(&inf->changed);
+		pthread_mutex_unlock(&inf->lock);
 
-	assert(!buffer_is_empty(pp));
-	if (buffer_peek(pp) != '>') {
-		PF_FAIL_STR(pp, "Expected '>' but found '%c' on line %zu.",
-		            buffer_peek(pp), pp->line_number);
+		for (size_t i = 0; i < inf->thread_count; i++) {
+			pthread_join(inf->threads[i], NULL);
+		}
 	}
+	pthread_cond_destroy(&inf->changed);
+	pthread_mutex_destroy(&inf->lock);
 
-	int check = buffer_advance(pp, 1); // skip >
-	if (check == E_EOF)
-		PF_FAIL_STR(pp, "Unexpected EOF in name on line %zu.", pp->line_number);
-	PF_FAIL_BUBBLE(pp);
+	for (size_t i = 0; i < INFLATE_SLOTS; i++) {
+		free(inf->slots[i].data);
+	}
 
-	check = copy_word(pp, &name);
-	if (check == E_EOF)
-		PF_FAIL_STR(pp, "Unexpected EOF in name on line %zu.", pp->line_number);
-	PF_FAIL_BUBBLE(pp);
+	if (inf->mapping) munmap(inf->mapping, inf->mapped_length);
+	free(inf->read_buffer);
+	free(inf->blocks);
+	free(inf);
+}
 
-	if (dynstr_len(&name) == 0)
-		PF_FAIL_STR(pp, "Empty name on line %zu.", pp->line_number);
+#else
 
-	pr->name_length = dynstr_len(&name);
-	pr->name = dynstr_move(&name);
+static int inflate_init(struct pfasta_parser *pp) {
+	int return_code = 0;
+	PF_FAIL_STR_CONST(pp, "Compressed input requires zlib support.");
 
 cleanup:
-	if (return_code) {
-		dynstr_free(&name);
-	}
 	return return_code;
 }
 
-int pfasta_read_comment(struct pfasta_parser *pp, struct pfasta_record *pr) {
-	int return_code = 0;
+static ssize_t inflate_next(struct pfasta_parser *pp) {
+	(void)pp;
+	return 0;
+}
 
-	if (buffer_peek(pp) == '\n') {
-		pr->comment_length = 0;
-		pr->comment = NULL;
-		return 0;
-	}
+static int bgzf_record_start(struct pfasta_inflate *inf) {
+	(void)inf;
+	return -1;
+}
 
-	dynstr comment;
-	dynstr_init(&comment, pp);
-	PF_FAIL_BUBBLE(pp);
+static void inflate_free(struct pfasta_inflate *inf) { free(inf); }
 
-	assert(!buffer_is_empty(pp));
+#endif
 
-	int check = buffer_advance(pp, 1); // skip first whitespace
-	if (check == E_EOF) goto label_eof;
-	PF_FAIL_BUBBLE(pp);
+/* Read-ahead. A reader thread keeps a ring of large buffers filled ahead of
+ * the parser, so that waiting for slow storage overlaps with parsing. The
+ * parser swaps to the next filled buffer whenever it runs out of data.
+ */
 
-	assert(!buffer_is_empty(pp));
+#define READAHEAD_BUFFERS 4
+#define READAHEAD_BUFFER_SIZE (1 << 20)
 
-	// get comment
-	while (buffer_peek(pp) != '\n') {
-		check = dynstr_append(&comment, buffer_begin(pp), 1, pp);
-		PF_FAIL_BUBBLE_CHECK(pp, check);
+struct readahead_buffer {
+	int state; // SLOT_FREE or SLOT_READY, like the inflate slots
+	ssize_t length;
+	int error;
+	char *data;
+};
 
-		check = buffer_advance(pp, 1);
-		if (check == E_EOF) goto label_eof;
-		PF_FAIL_BUBBLE_CHECK(pp, check);
-	}
+struct pfasta_readahead {
+	int file_descriptor;
+	char *initial; // the parser's own buffer, still being walked at the start
 
-label_eof:
-	if (buffer_is_eof(pp))
-		PF_FAIL_STR(pp, "Unexpected EOF in comment on line %zu.",
-		            pp->line_number);
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	pthread_t thread;
+	int started;
+	int stop; // set when the parser is freed
 
-	pr->comment_length = dynstr_len(&comment);
-	pr->comment = dynstr_move(&comment);
+	struct readahead_buffer buffers[READAHEAD_BUFFERS];
+	struct readahead_buffer *current; // the buffer the parser is walking
+	size_t next_fill;                 // next buffer to be filled
+	size_t next_delivery;             // next buffer to hand to the parser
+};
 
-cleanup:
-	if (return_code) {
-		dynstr_free(&comment);
+static void *readahead_work(void *arg) {
+	struct pfasta_readahead *ra = arg;
+
+	// Only the blocking read may be cancelled; it runs without the lock.
+	(void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+	while (1) {
+		struct readahead_buffer *buffer =
+		    &ra->buffers[ra->next_fill % READAHEAD_BUFFERS];
+
+		pthread_mutex_lock(&ra->lock);
+		while (buffer->state != SLOT_FREE && !ra->stop) {
+			pthread_cond_wait(&ra->changed, &ra->lock);
+		}
+		int stop = ra->stop;
+		pthread_mutex_unlock(&ra->lock);
+		if (stop) break;
+
+		(void)pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		ssize_t count;
+		do {
+			count = read(ra->file_descriptor, buffer->data,
+			             READAHEAD_BUFFER_SIZE);
+		} while (count < 0 && errno == EINTR);
+		int error = errno;
+		(void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+		pthread_mutex_lock(&ra->lock);
+		buffer->length = count;
+		buffer->error = error;
+		buffer->state = SLOT_READY;
+		ra->next_fill++;
+		pthread_cond_broadcast(&ra->changed);
+		pthread_mutex_unlock(&ra->lock);
+
+		if (count <= 0) break; // EOF or error; the parser stops here, too
 	}
-	return return_code;
+
+	return NULL;
 }
 
-int pfasta_read_sequence(struct pfasta_parser *pp, struct pfasta_record *pr) {
-	int return_code = 0;
+/** @brief Hand reading over to a reader thread. The unconsumed data in the
+ * parser's buffer is walked first.
+ *
+ * @returns 0 iff successful. Otherwise, the parser is left as it was.
+ */
+static int readahead_init(struct pfasta_parser *pp) {
+	int return_code = -1;
 
-	dynstr sequence;
-	dynstr_init(&sequence, pp);
-	PF_FAIL_BUBBLE(pp);
+	struct pfasta_readahead *ra = calloc(1, sizeof(*ra));
+	if (!ra) return return_code;
+	pthread_mutex_init(&ra->lock, NULL);
+	pthread_cond_init(&ra->changed, NULL);
 
-	assert(!buffer_is_empty(pp));
-	assert(!buffer_is_eof(pp));
-	assert(buffer_peek(pp) == '\n');
+	for (size_t i = 0; i < READAHEAD_BUFFERS; i++) {
+		ra->buffers[i].data = malloc(READAHEAD_BUFFER_SIZE);
+		if (!ra->buffers[i].data) goto cleanup;
+	}
+
+	ra->file_descriptor = pp->file_descriptor;
+	if (pthread_create(&ra->thread, NULL, readahead_work, ra)) goto cleanup;
+	ra->started = 1;
+
+	ra->initial = pp->buffer;
+	pp->backend = BACKEND_READAHEAD;
+	pp->readahead = ra;
+	return_code = 0;
+
+cleanup:
+	if (return_code) readahead_free(ra);
+	return return_code;
+}
+
+/** @brief Hand the next filled buffer to the parser.
+ *
+ * @returns the number of bytes in the buffer, 0 at the end of the input, or -1
+ * with errno set on error.
+ */
+static ssize_t readahead_next(struct pfasta_parser *pp) {
+	struct pfasta_readahead *ra = pp->readahead;
+
+	pthread_mutex_lock(&ra->lock);
+	if (ra->current) {
+		ra->current->state = SLOT_FREE;
+		ra->current = NULL;
+		pthread_cond_broadcast(&ra->changed);
+	}
+
+	struct readahead_buffer *buffer =
+	    &ra->buffers[ra->next_delivery % READAHEAD_BUFFERS];
+	while (buffer->state != SLOT_READY) {
+		pthread_cond_wait(&ra->changed, &ra->lock);
+	}
+
+	ssize_t count = buffer->length;
+	if (count > 0) {
+		// Keep the final buffer, so that reading past the end stays at EOF.
+		ra->current = buffer;
+		ra->next_delivery++;
+		pp->buffer = buffer->data;
+	}
+	if (count < 0) errno = buffer->error;
+	pthread_mutex_unlock(&ra->lock);
+
+	return count;
+}
+
+static void readahead_free(struct pfasta_readahead *ra) {
+	if (!ra) return;
+
+	if (ra->started) {
+		// A waiting reader wakes up and stops; a blocking read is cancelled.
+		pthread_mutex_lock(&ra->lock);
+		ra->stop = 1;
+		pthread_cond_broadcast(&ra->changed);
+		pthread_mutex_unlock(&ra->lock);
+
+		(void)pthread_cancel(ra->thread);
+		pthread_join(ra->thread, NULL);
+	}
+	pthread_cond_destroy(&ra->changed);
+	pthread_mutex_destroy(&ra->lock);
+
+	for (size_t i = 0; i < READAHEAD_BUFFERS; i++) {
+		free(ra->buffers[i].data);
+	}
+	free(ra->initial);
+	free(ra);
+}
+
+/* The scanning kernels exist in several flavours. The generic ones work
+ * everywhere; on x86 wider versions are compiled via target attributes and the
+ * best one supported by the CPU is picked once at runtime. Thus, a library
+ * built without any -march flags still uses AVX2 or AVX-512 when available.
+ */
+
+char *find_first_space_generic(const char *begin, const char *end) {
+	size_t offset = 0;
+	size_t length = end - begin;
+
+	for (; offset < length; offset++) {
+		if (my_isspace(begin[offset])) break;
+	}
+	return (char *)begin + offset;
+}
+
+char *find_first_not_space_generic(const char *begin, const char *end) {
+	size_t offset = 0;
+	size_t length = end - begin;
+
+	for (; offset < length; offset++) {
+		if (!my_isspace(begin[offset])) break;
+	}
+	return (char *)begin + offset;
+}
+
+size_t count_newlines_generic(const char *begin, const char *end) {
+	size_t offset = 0;
+	size_t length = end - begin;
+	size_t newlines = 0;
+
+	for (; offset < length; offset++) {
+		if (begin[offset] == '\n') newlines++;
+	}
+
+	return newlines;
+}
+
+#if PF_DISPATCH
+
+/** @brief Bit mask of the whitespace characters in a 16 byte chunk. */
+__attribute__((target("sse2"))) static inline unsigned int
+space_mask_sse2(__m128i chunk) {
+	const __m128i all_tab = _mm_set1_epi8('\t' - 1);
+	const __m128i all_carriage = _mm_set1_epi8('\r' + 1);
+	const __m128i all_space = _mm_set1_epi8(' ');
+
+	// isspace: \t <= char <= \r || char == space
+	__m128i v1 = _mm_cmplt_epi8(all_tab, chunk);
+	__m128i v2 = _mm_cmplt_epi8(chunk, all_carriage);
+	__m128i v3 = _mm_cmpeq_epi8(chunk, all_space);
+
+	return _mm_movemask_epi8(_mm_or_si128(_mm_and_si128(v1, v2), v3));
+}
+
+__attribute__((target("sse2"))) char *
+find_first_space_sse2(const char *begin, const char *end) {
+	static const size_t vec_size = sizeof(__m128i);
+	size_t offset = 0;
+	size_t length = end - begin;
+
+	for (; offset + vec_size <= length; offset += vec_size) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)(begin + offset));
+		unsigned int vmask = space_mask_sse2(chunk);
+
+		if (UNLIKELY(vmask)) {
+			return (char *)begin + offset + __builtin_ctz(vmask);
+		}
+	}
+
+	return find_first_space_generic(begin + offset, end);
+}
+
+__attribute__((target("sse2"))) char *
+find_first_not_space_sse2(const char *begin, const char *end) {
+	static const size_t vec_size = sizeof(__m128i);
+	size_t offset = 0;
+	size_t length = end - begin;
+
+	for (; offset + vec_size <= length; offset += vec_size) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)(begin + offset));
+		unsigned int vmask = ~space_mask_sse2(chunk) & 0xffff;
+
+		if (vmask) {
+			return (char *)begin + offset + __builtin_ctz(vmask);
+		}
+	}
+
+	return find_first_not_space_generic(begin + offset, end);
+}
+
+__attribute__((target("sse2,popcnt"))) size_t
+count_newlines_sse2(const char *begin, const char *end) {
+	static const size_t vec_size = sizeof(__m128i);
+	const __m128i all_newline = _mm_set1_epi8('\n');
+	size_t offset = 0;
+	size_t length = end - begin;
+	size_t newlines = 0;
+
+	for (; offset + vec_size <= length; offset += vec_size) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)(begin + offset));
+		__m128i eq = _mm_cmpeq_epi8(chunk, all_newline);
+		newlines += __builtin_popcount(_mm_movemask_epi8(eq));
+	}
+
+	return newlines + count_newlines_generic(begin + offset, end);
+}
+
+/** @brief Bit mask of the whitespace characters in a 32 byte chunk. */
+__attribute__((target("avx2"))) static inline unsigned int
+space_mask_avx2(__m256i chunk) {
+	const __m256i all_tab = _mm256_set1_epi8('\t' - 1);
+	const __m256i all_carriage = _mm256_set1_epi8('\r' + 1);
+	const __m256i all_space = _mm256_set1_epi8(' ');
+
+	__m256i v1 = _mm256_cmpgt_epi8(chunk, all_tab);
+	__m256i v2 = _mm256_cmpgt_epi8(all_carriage, chunk);
+	__m256i v3 = _mm256_cmpeq_epi8(chunk, all_space);
+
+	return _mm256_movemask_epi8(
+	    _mm256_or_si256(_mm256_and_si256(v1, v2), v3));
+}
+
+__attribute__((target("avx2,bmi"))) char *
+find_first_space_avx2(const char *begin, const char *end) {
+	static const size_t vec_size = sizeof(__m256i);
+	size_t offset = 0;
+	size_t length = end - begin;
+
+	for (; offset + vec_size <= length; offset += vec_size) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *)(begin + offset));
+		unsigned int vmask = space_mask_avx2(chunk);
+
+		if (UNLIKELY(vmask)) {
+			return (char *)begin + offset + __builtin_ctz(vmask);
+		}
+	}
+
+	return find_first_space_sse2(begin + offset, end);
+}
+
+__attribute__((target("avx2,bmi"))) char *
+find_first_not_space_avx2(const char *begin, const char *end) {
+	static const size_t vec_size = sizeof(__m256i);
+	size_t offset = 0;
+	size_t length = end - begin;
+
+	for (; offset + vec_size <= length; offset += vec_size) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *)(begin + offset));
+		unsigned int vmask = ~space_mask_avx2(chunk);
+
+		if (vmask) {
+			return (char *)begin + offset + __builtin_ctz(vmask);
+		}
+	}
+
+	return find_first_not_space_sse2(begin + offset, end);
+}
+
+__attribute__((target("avx2,popcnt"))) size_t
+count_newlines_avx2(const char *begin, const char *end) {
+	static const size_t vec_size = sizeof(__m256i);
+	const __m256i all_newline = _mm256_set1_epi8('\n');
+	size_t offset = 0;
+	size_t length = end - begin;
+	size_t newlines = 0;
+
+	for (; offset + vec_size <= length; offset += vec_size) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *)(begin + offset));
+		__m256i eq = _mm256_cmpeq_epi8(chunk, all_newline);
+		newlines += __builtin_popcount(_mm256_movemask_epi8(eq));
+	}
+
+	return newlines + count_newlines_sse2(begin + offset, end);
+}
+
+/** @brief Bit mask of the whitespace characters among the first `length`
+ * bytes. AVX-512 can load partial vectors, so no scalar tail is needed.
+ */
+__attribute__((target("avx512f,avx512bw"))) static inline uint64_t
+space_mask_avx512(const char *ptr, size_t length) {
+	__mmask64 load = length >= 64 ? ~0ULL : (1ULL << length) - 1;
+	__m512i chunk = _mm512_maskz_loadu_epi8(load, ptr);
+
+	// \t <= c <= \r  <=>  (unsigned)(c - \t) <= 4
+	__m512i shifted = _mm512_sub_epi8(chunk, _mm512_set1_epi8('\t'));
+	__mmask64 range = _mm512_cmple_epu8_mask(shifted, _mm512_set1_epi8(4));
+	__mmask64 space = _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(' '));
+
+	return (range | space) & load;
+}
+
+__attribute__((target("avx512f,avx512bw,bmi"))) char *
+find_first_space_avx512(const char *begin, const char *end) {
+	size_t offset = 0;
+	size_t length = end - begin;
+
+	for (; offset < length; offset += 64) {
+		uint64_t vmask = space_mask_avx512(begin + offset, length - offset);
+
+		if (UNLIKELY(vmask)) {
+			return (char *)begin + offset + __builtin_ctzll(vmask);
+		}
+	}
+
+	return (char *)end;
+}
+
+__attribute__((target("avx512f,avx512bw,bmi"))) char *
+find_first_not_space_avx512(const char *begin, const char *end) {
+	size_t offset = 0;
+	size_t length = end - begin;
+
+	for (; offset < length; offset += 64) {
+		size_t rest = length - offset;
+		uint64_t load = rest >= 64 ? ~0ULL : (1ULL << rest) - 1;
+		uint64_t vmask = ~space_mask_avx512(begin + offset, rest) & load;
+
+		if (vmask) {
+			return (char *)begin + offset + __builtin_ctzll(vmask);
+		}
+	}
+
+	return (char *)end;
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt"))) size_t
+count_newlines_avx512(const char *begin, const char *end) {
+	const __m512i all_newline = _mm512_set1_epi8('\n');
+	size_t offset = 0;
+	size_t length = end - begin;
+	size_t newlines = 0;
+
+	for (; offset < length; offset += 64) {
+		size_t rest = length - offset;
+		__mmask64 load = rest >= 64 ? ~0ULL : (1ULL << rest) - 1;
+		__m512i chunk = _mm512_maskz_loadu_epi8(load, begin + offset);
+		__mmask64 eq = _mm512_mask_cmpeq_epi8_mask(load, chunk, all_newline);
+		newlines += __builtin_popcountll(eq);
+	}
+
+	return newlines;
+}
+
+#endif
+
+static char *(*find_first_space)(const char *begin,
+                                 const char *end) = find_first_space_generic;
+static char *(*find_first_not_space)(const char *begin, const char *end) =
+    find_first_not_space_generic;
+static size_t (*count_newlines)(const char *begin,
+                                const char *end) = count_newlines_generic;
+
+/* Sequences that are skipped are only counted. A sequence consists of words
+ * separated by whitespace, and every word has to begin like a sequence line.
+ * The kernels count the residues and newlines up to the first word that does
+ * not, which then is left to the parser.
+ */
+
+/** @brief Count the residues and newlines from `begin` up to `end`, or up to
+ * the first word that cannot belong to a sequence.
+ *
+ * @param after_space - Iff set, the byte before `begin` is whitespace. Updated
+ * for the next call.
+ * @param stop - Set to where counting stopped.
+ * @returns the number of residues.
+ */
+size_t skip_residues_generic(const char *begin, const char *end,
+                             int *after_space, size_t *newlines,
+                             const char **stop) {
+	const char *ptr = begin;
+	size_t residues = 0;
+	int space = *after_space;
+
+	for (; ptr < end; ptr++) {
+		int c = (unsigned char)*ptr;
+		if (my_isspace(c)) {
+			*newlines += c == '\n';
+			space = 1;
+			continue;
+		}
+		if (space && !(isalpha(c) || c == '-' || c == '*')) break;
+		space = 0;
+		residues++;
+	}
+
+	*after_space = space;
+	*stop = ptr;
+	return residues;
+}
+
+#if PF_DISPATCH
+
+/** @brief Bit mask of the characters in a 16 byte chunk that may begin a
+ * sequence line: letters, '-' and '*'.
+ */
+__attribute__((target("sse2"))) static inline unsigned int
+residue_mask_sse2(__m128i chunk) {
+	__m128i lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+	__m128i alpha =
+	    _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+	                  _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+	__m128i dash = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('-'));
+	__m128i star = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('*'));
+
+	return _mm_movemask_epi8(_mm_or_si128(alpha, _mm_or_si128(dash, star)));
+}
+
+__attribute__((target("sse2,popcnt"))) size_t
+skip_residues_sse2(const char *begin, const char *end, int *after_space,
+                   size_t *newlines, const char **stop) {
+	static const size_t vec_size = sizeof(__m128i);
+	const __m128i all_newline = _mm_set1_epi8('\n');
+	size_t offset = 0;
+	size_t length = end - begin;
+	size_t residues = 0;
+	unsigned int carry = *after_space;
+
+	for (; offset + vec_size <= length; offset += vec_size) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)(begin + offset));
+		unsigned int space = space_mask_sse2(chunk);
+		unsigned int newline =
+		    _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, all_newline));
+		unsigned int starts = ~space & ((space << 1) | carry) & 0xFFFF;
+		unsigned int bad = starts & ~residue_mask_sse2(chunk);
+
+		if (UNLIKELY(bad)) {
+			unsigned int before = (1u << __builtin_ctz(bad)) - 1;
+			*newlines += __builtin_popcount(newline & before);
+			*after_space = 1;
+			*stop = begin + offset + __builtin_ctz(bad);
+			return residues + __builtin_popcount(~space & before);
+		}
+
+		*newlines += __builtin_popcount(newline);
+		residues += __builtin_popcount(~space & 0xFFFF);
+		carry = space >> 15;
+	}
+
+	*after_space = carry;
+	return residues + skip_residues_generic(begin + offset, end, after_space,
+	                                        newlines, stop);
+}
+
+/** @brief Bit mask of the characters in a 32 byte chunk that may begin a
+ * sequence line: letters, '-' and '*'.
+ */
+__attribute__((target("avx2"))) static inline unsigned int
+residue_mask_avx2(__m256i chunk) {
+	__m256i lower = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));
+	__m256i alpha =
+	    _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+	                     _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+	__m256i dash = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('-'));
+	__m256i star = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('*'));
+
+	return _mm256_movemask_epi8(
+	    _mm256_or_si256(alpha, _mm256_or_si256(dash, star)));
+}
+
+__attribute__((target("avx2,bmi,popcnt"))) size_t
+skip_residues_avx2(const char *begin, const char *end, int *after_space,
+                   size_t *newlines, const char **stop) {
+	static const size_t vec_size = sizeof(__m256i);
+	const __m256i all_newline = _mm256_set1_epi8('\n');
+	size_t offset = 0;
+	size_t length = end - begin;
+	size_t residues = 0;
+	uint32_t carry = *after_space;
+
+	for (; offset + vec_size <= length; offset += vec_size) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *)(begin + offset));
+		uint32_t space = space_mask_avx2(chunk);
+		uint32_t newline =
+		    _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, all_newline));
+		uint32_t starts = ~space & ((space << 1) | carry);
+		uint32_t bad = starts & ~residue_mask_avx2(chunk);
+
+		if (UNLIKELY(bad)) {
+			uint32_t before = (uint32_t)(((uint64_t)1 << __builtin_ctz(bad)) - 1);
+			*newlines += __builtin_popcount(newline & before);
+			*after_space = 1;
+			*stop = begin + offset + __builtin_ctz(bad);
+			return residues + __builtin_popcount(~space & before);
+		}
+
+		*newlines += __builtin_popcount(newline);
+		residues += __builtin_popcount(~space);
+		carry = space >> 31;
+	}
+
+	*after_space = carry;
+	return residues + skip_residues_generic(begin + offset, end, after_space,
+	                                        newlines, stop);
+}
+
+#endif
+
+static size_t (*skip_residues)(const char *begin, const char *end,
+                               int *after_space, size_t *newlines,
+                               const char **stop) = skip_residues_generic;
+
+/* In structural mode the input is processed in two stages. First, a window of
+ * up to STRUCTURE_BYTES is classified in one SIMD pass into bitmaps of
+ * whitespace, newlines and '>'. Second, the parser walks these bitmaps to find
+ * the ends of words and lines, without looking at individual bytes again.
+ */
+
+#define STRUCTURE_BYTES BUFFER_SIZE
+#define STRUCTURE_WORDS (STRUCTURE_BYTES / 64)
+
+struct pfasta_structure {
+	const char *base, *limit;
+	uint64_t space[STRUCTURE_WORDS];
+	uint64_t newline[STRUCTURE_WORDS];
+	uint64_t header[STRUCTURE_WORDS];
+};
+
+/** @brief Classify `blocks` chunks of 64 bytes each. Bit i of word k refers to
+ * the byte at `ptr[64 * k + i]`.
+ */
+void classify_generic(const char *ptr, size_t blocks, uint64_t *space,
+                      uint64_t *newline, uint64_t *header) {
+	for (size_t k = 0; k < blocks; k++) {
+		uint64_t s = 0, n = 0, h = 0;
+		for (size_t i = 0; i < 64; i++) {
+			unsigned char c = ptr[64 * k + i];
+			s |= (uint64_t)my_isspace(c) << i;
+			n |= (uint64_t)(c == '\n') << i;
+			h |= (uint64_t)(c == '>') << i;
+		}
+		space[k] = s;
+		newline[k] = n;
+		header[k] = h;
+	}
+}
+
+#if PF_DISPATCH
+
+__attribute__((target("sse2"))) void
+classify_sse2(const char *ptr, size_t blocks, uint64_t *space,
+              uint64_t *newline, uint64_t *header) {
+	const __m128i all_newline = _mm_set1_epi8('\n');
+	const __m128i all_gt = _mm_set1_epi8('>');
+
+	for (size_t k = 0; k < blocks; k++) {
+		uint64_t s = 0, n = 0, h = 0;
+		for (size_t i = 0; i < 4; i++) {
+			__m128i chunk =
+			    _mm_loadu_si128((const __m128i *)(ptr + 64 * k + 16 * i));
+			uint64_t eq_n = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, all_newline));
+			uint64_t eq_h = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, all_gt));
+			s |= (uint64_t)space_mask_sse2(chunk) << (16 * i);
+			n |= eq_n << (16 * i);
+			h |= eq_h << (16 * i);
+		}
+		space[k] = s;
+		newline[k] = n;
+		header[k] = h;
+	}
+}
+
+__attribute__((target("avx2"))) void
+classify_avx2(const char *ptr, size_t blocks, uint64_t *space,
+              uint64_t *newline, uint64_t *header) {
+	const __m256i all_newline = _mm256_set1_epi8('\n');
+	const __m256i all_gt = _mm256_set1_epi8('>');
+
+	for (size_t k = 0; k < blocks; k++) {
+		__m256i lo = _mm256_loadu_si256((const __m256i *)(ptr + 64 * k));
+		__m256i hi = _mm256_loadu_si256((const __m256i *)(ptr + 64 * k + 32));
+
+		uint32_t n_lo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, all_newline));
+		uint32_t n_hi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, all_newline));
+		uint32_t h_lo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, all_gt));
+		uint32_t h_hi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, all_gt));
+
+		space[k] = space_mask_avx2(lo) | (uint64_t)space_mask_avx2(hi) << 32;
+		newline[k] = n_lo | (uint64_t)n_hi << 32;
+		header[k] = h_lo | (uint64_t)h_hi << 32;
+	}
+}
+
+__attribute__((target("avx512f,avx512bw"))) void
+classify_avx512(const char *ptr, size_t blocks, uint64_t *space,
+                uint64_t *newline, uint64_t *header) {
+	const __m512i all_newline = _mm512_set1_epi8('\n');
+	const __m512i all_gt = _mm512_set1_epi8('>');
+
+	for (size_t k = 0; k < blocks; k++) {
+		__m512i chunk = _mm512_loadu_si512((const void *)(ptr + 64 * k));
+
+		space[k] = space_mask_avx512(ptr + 64 * k, 64);
+		newline[k] = _mm512_cmpeq_epi8_mask(chunk, all_newline);
+		header[k] = _mm512_cmpeq_epi8_mask(chunk, all_gt);
+	}
+}
+
+#endif
+
+static void (*classify)(const char *ptr, size_t blocks, uint64_t *space,
+                        uint64_t *newline, uint64_t *header) = classify_generic;
+
+/* Packed sequences store two bits per base. The code is taken from bits 1 and 2
+ * of the character, which maps both A and a to 0, C to 1, T to 2 and G to 3.
+ * Thus, the complement of a code is the code xor 2, and C and G are exactly
+ * the codes with the low bit set. Everything but ACGT is an exception.
+ */
+
+/** @brief Pack `blocks` chunks of 32 characters each. Word k holds the codes
+ * of `ptr[32 * k]` and following, lowest bits first. Bit i of `exception[k]`
+ * and `lower[k]` marks the character `ptr[32 * k + i]` as something other
+ * than ACGT, or as a lower case letter, respectively.
+ */
+void pack_generic(const char *ptr, size_t blocks, uint64_t *words,
+                  uint32_t *exception, uint32_t *lower) {
+	for (size_t k = 0; k < blocks; k++) {
+		uint64_t w = 0;
+		uint32_t e = 0, l = 0;
+		for (size_t i = 0; i < 32; i++) {
+			unsigned char c = ptr[32 * k + i];
+			unsigned char u = c & 0xDF;
+			w |= (uint64_t)((c >> 1) & 3) << (2 * i);
+			e |= (uint32_t)!(u == 'A' || u == 'C' || u == 'G' || u == 'T') << i;
+			l |= (uint32_t)(c >= 'a' && c <= 'z') << i;
+		}
+		words[k] = w;
+		exception[k] = e;
+		lower[k] = l;
+	}
+}
+
+#if PF_DISPATCH
+
+/** @brief Gather the codes of the bytes in each 64 bit lane into its lowest 16
+ * bits, two bits per byte.
+ */
+__attribute__((target("sse2"))) static inline __m128i
+pack_lanes_sse2(__m128i chunk) {
+	__m128i v = _mm_and_si128(_mm_srli_epi16(chunk, 1), _mm_set1_epi8(3));
+	v = _mm_and_si128(_mm_or_si128(v, _mm_srli_epi16(v, 6)),
+	                  _mm_set1_epi16(0x000F));
+	v = _mm_and_si128(_mm_or_si128(v, _mm_srli_epi32(v, 12)),
+	                  _mm_set1_epi32(0x00FF));
+	v = _mm_and_si128(_mm_or_si128(v, _mm_srli_epi64(v, 24)),
+	                  _mm_set1_epi64x(0xFFFF));
+	return v;
+}
+
+__attribute__((target("sse2"))) void
+pack_sse2(const char *ptr, size_t blocks, uint64_t *words, uint32_t *exception,
+          uint32_t *lower) {
+	const __m128i case_mask = _mm_set1_epi8((char)0xDF);
+	const __m128i all_a = _mm_set1_epi8('A');
+	const __m128i all_c = _mm_set1_epi8('C');
+	const __m128i all_g = _mm_set1_epi8('G');
+	const __m128i all_t = _mm_set1_epi8('T');
+	const __m128i before_a = _mm_set1_epi8('a' - 1);
+	const __m128i after_z = _mm_set1_epi8('z' + 1);
+
+	for (size_t k = 0; k < blocks; k++) {
+		uint64_t w = 0;
+		uint32_t e = 0, l = 0;
+		for (size_t i = 0; i < 2; i++) {
+			__m128i chunk =
+			    _mm_loadu_si128((const __m128i *)(ptr + 32 * k + 16 * i));
+			__m128i upper = _mm_and_si128(chunk, case_mask);
+			__m128i acgt = _mm_or_si128(
+			    _mm_or_si128(_mm_cmpeq_epi8(upper, all_a),
+			                 _mm_cmpeq_epi8(upper, all_c)),
+			    _mm_or_si128(_mm_cmpeq_epi8(upper, all_g),
+			                 _mm_cmpeq_epi8(upper, all_t)));
+			__m128i is_lower = _mm_and_si128(_mm_cmpgt_epi8(chunk, before_a),
+			                                 _mm_cmplt_epi8(chunk, after_z));
+
+			__m128i lanes = pack_lanes_sse2(chunk);
+			uint64_t codes = (uint32_t)_mm_extract_epi16(lanes, 0) |
+			                 (uint32_t)_mm_extract_epi16(lanes, 4) << 16;
+
+			w |= codes << (32 * i);
+			e |= (~(uint32_t)_mm_movemask_epi8(acgt) & 0xFFFF) << (16 * i);
+			l |= (uint32_t)_mm_movemask_epi8(is_lower) << (16 * i);
+		}
+		words[k] = w;
+		exception[k] = e;
+		lower[k] = l;
+	}
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+pack_lanes_avx2(__m256i chunk) {
+	__m256i v =
+	    _mm256_and_si256(_mm256_srli_epi16(chunk, 1), _mm256_set1_epi8(3));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_srli_epi16(v, 6)),
+	                     _mm256_set1_epi16(0x000F));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_srli_epi32(v, 12)),
+	                     _mm256_set1_epi32(0x00FF));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_srli_epi64(v, 24)),
+	                     _mm256_set1_epi64x(0xFFFF));
+	return v;
+}
+
+__attribute__((target("avx2"))) void
+pack_avx2(const char *ptr, size_t blocks, uint64_t *words, uint32_t *exception,
+          uint32_t *lower) {
+	const __m256i case_mask = _mm256_set1_epi8((char)0xDF);
+	const __m256i all_a = _mm256_set1_epi8('A');
+	const __m256i all_c = _mm256_set1_epi8('C');
+	const __m256i all_g = _mm256_set1_epi8('G');
+	const __m256i all_t = _mm256_set1_epi8('T');
+	const __m256i before_a = _mm256_set1_epi8('a' - 1);
+	const __m256i after_z = _mm256_set1_epi8('z' + 1);
+
+	for (size_t k = 0; k < blocks; k++) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *)(ptr + 32 * k));
+		__m256i upper = _mm256_and_si256(chunk, case_mask);
+		__m256i acgt = _mm256_or_si256(
+		    _mm256_or_si256(_mm256_cmpeq_epi8(upper, all_a),
+		                    _mm256_cmpeq_epi8(upper, all_c)),
+		    _mm256_or_si256(_mm256_cmpeq_epi8(upper, all_g),
+		                    _mm256_cmpeq_epi8(upper, all_t)));
+		__m256i is_lower = _mm256_and_si256(_mm256_cmpgt_epi8(chunk, before_a),
+		                                    _mm256_cmpgt_epi8(after_z, chunk));
+
+		__m256i v = pack_lanes_avx2(chunk);
+		words[k] = (uint64_t)(uint16_t)_mm256_extract_epi16(v, 0) |
+		           (uint64_t)(uint16_t)_mm256_extract_epi16(v, 4) << 16 |
+		           (uint64_t)(uint16_t)_mm256_extract_epi16(v, 8) << 32 |
+		           (uint64_t)(uint16_t)_mm256_extract_epi16(v, 12) << 48;
+		exception[k] = ~(uint32_t)_mm256_movemask_epi8(acgt);
+		lower[k] = _mm256_movemask_epi8(is_lower);
+	}
+}
+
+#endif
+
+static void (*pack_blocks)(const char *ptr, size_t blocks, uint64_t *words,
+                           uint32_t *exception,
+                           uint32_t *lower) = pack_generic;
+
+/* Sequences can be translated while they are copied out of the buffer. The
+ * table maps every byte to its replacement, to PFASTA_DROP or to PFASTA_REJECT.
+ * Most residues either stay the same or are only uppercased; the bitmaps mark
+ * those among the ASCII characters: bit c >> 4 of `keep[c & 15]` is set iff c
+ * stays, and likewise for `fold`.
+ */
+struct pfasta_transform {
+	unsigned char table[256];
+	uint8_t keep[16], fold[16];
+};
+
+/** @brief Translate `length` characters from `src` to `dest`, which may be
+ * the same. Sets `rejected` if any of them maps to PFASTA_REJECT.
+ *
+ * @returns the number of characters written.
+ */
+size_t translate_generic(const struct pfasta_transform *tf, char *dest,
+                         const char *src, size_t length, int *rejected) {
+	char *out = dest;
+	int bad = 0;
+	for (size_t i = 0; i < length; i++) {
+		unsigned char t = tf->table[(unsigned char)src[i]];
+		*out = t;
+		out += t != PFASTA_DROP;
+		bad |= t == PFASTA_REJECT;
+	}
+	*rejected |= bad;
+	return out - dest;
+}
+
+#if PF_DISPATCH
+
+/** @brief Blocks of 32 characters that only stay or get uppercased are
+ * translated with two table lookups by nibble. Others take the generic path.
+ */
+__attribute__((target("avx2"))) size_t
+translate_avx2(const struct pfasta_transform *tf, char *dest, const char *src,
+               size_t length, int *rejected) {
+	const __m256i keep = _mm256_broadcastsi128_si256(
+	    _mm_loadu_si128((const __m128i *)tf->keep));
+	const __m256i fold = _mm256_broadcastsi128_si256(
+	    _mm_loadu_si128((const __m128i *)tf->fold));
+	// Non-ASCII characters select no bit, and thus neither stay nor fold.
+	const __m256i bits = _mm256_setr_epi8(
+	    1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0, //
+	    1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+	const __m256i zero = _mm256_setzero_si256();
+
+	char *out = dest;
+	size_t i = 0;
+	for (; i + 32 <= length; i += 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i low = _mm256_and_si256(chunk, nibble);
+		__m256i high =
+		    _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble);
+		__m256i bit = _mm256_shuffle_epi8(bits, high);
+
+		__m256i no_keep = _mm256_cmpeq_epi8(
+		    _mm256_and_si256(_mm256_shuffle_epi8(keep, low), bit), zero);
+		__m256i no_fold = _mm256_cmpeq_epi8(
+		    _mm256_and_si256(_mm256_shuffle_epi8(fold, low), bit), zero);
+
+		if (_mm256_movemask_epi8(_mm256_and_si256(no_keep, no_fold))) {
+			out += translate_generic(tf, out, src + i, 32, rejected);
+			continue;
+		}
+
+		__m256i delta = _mm256_andnot_si256(no_fold, _mm256_set1_epi8(0x20));
+		_mm256_storeu_si256((__m256i *)out, _mm256_sub_epi8(chunk, delta));
+		out += 32;
+	}
+
+	out += translate_generic(tf, out, src + i, length - i, rejected);
+	return out - dest;
+}
+
+#endif
+
+static size_t (*translate)(const struct pfasta_transform *tf, char *dest,
+                           const char *src, size_t length,
+                           int *rejected) = translate_generic;
+
+/** @brief Stage one: classify the window starting at `begin`. */
+static void structure_classify(struct pfasta_structure *st, const char *begin,
+                               const char *end) {
+	size_t length = end - begin;
+	if (length > STRUCTURE_BYTES) length = STRUCTURE_BYTES;
+
+	size_t blocks = length / 64;
+	size_t rest = length % 64;
+	classify(begin, blocks, st->space, st->newline, st->header);
+
+	if (rest) {
+		// Pad the tail with zeros; they belong to no class.
+		char block[64] = {0};
+		memcpy(block, begin + 64 * blocks, rest);
+		classify(block, 1, st->space + blocks, st->newline + blocks,
+		         st->header + blocks);
+	}
+
+	st->base = begin;
+	st->limit = begin + length;
+}
+
+/** @brief Forget the classification, e.g. because the buffer was refilled. */
+static inline void structure_invalidate(struct pfasta_structure *st) {
+	if (st) st->base = st->limit = NULL;
+}
+
+/** @brief Make sure `ptr` lies within the classified window. */
+static inline void structure_ensure(struct pfasta_parser *pp, const char *ptr) {
+	struct pfasta_structure *st = pp->structure;
+	if (UNLIKELY(ptr < st->base || ptr >= st->limit)) {
+		structure_classify(st, ptr, buffer_end(pp));
+	}
+}
+
+/** @brief Stage two: find the first byte in [begin, end) that is whitespace
+ * (`want_space` set) or not whitespace (`want_space` unset).
+ */
+static char *structure_find(struct pfasta_parser *pp, const char *begin,
+                            const char *end, int want_space) {
+	struct pfasta_structure *st = pp->structure;
+	const uint64_t flip = want_space ? 0 : ~0ULL;
+	const char *ptr = begin;
+
+	while (ptr < end) {
+		structure_ensure(pp, ptr);
+
+		size_t offset = ptr - st->base;
+		size_t words = (st->limit - st->base + 63) / 64;
+		size_t word = offset / 64;
+		uint64_t bits = (st->space[word] ^ flip) & (~0ULL << (offset % 64));
+
+		while (!bits && ++word < words) {
+			bits = st->space[word] ^ flip;
+		}
+
+		if (bits) {
+			const char *hit = st->base + 64 * word + __builtin_ctzll(bits);
+			// hits in the zero padding are not real
+			if (hit < st->limit) return (char *)(hit < end ? hit : end);
+		}
+
+		ptr = st->limit;
+	}
+
+	return (char *)end;
+}
+
+/** @brief Count the newlines in [begin, end) using the bitmaps. */
+static size_t structure_count_newlines(struct pfasta_parser *pp,
+                                       const char *begin, const char *end) {
+	struct pfasta_structure *st = pp->structure;
+	const char *ptr = begin;
+	size_t newlines = 0;
+
+	while (ptr < end) {
+		structure_ensure(pp, ptr);
+
+		const char *stop = end < st->limit ? end : st->limit;
+		size_t from = ptr - st->base;
+		size_t to = stop - st->base;
+
+		for (size_t word = from / 64; word * 64 < to; word++) {
+			uint64_t bits = st->newline[word];
+			if (word == from / 64) bits &= ~0ULL << (from % 64);
+			if (word == to / 64) bits &= (1ULL << (to % 64)) - 1;
+			newlines += __builtin_popcountll(bits);
+		}
+
+		ptr = stop;
+	}
+
+	return newlines;
+}
+
+/** @brief Test bit `offset` of a bitmap. */
+static inline int bit_at(const uint64_t *bitmap, size_t offset) {
+	return (bitmap[offset / 64] >> (offset % 64)) & 1;
+}
+
+static inline char *scan_space(struct pfasta_parser *pp, const char *begin,
+                               const char *end) {
+	if (pp->structure) return structure_find(pp, begin, end, 1);
+	return find_first_space(begin, end);
+}
+
+static inline char *scan_not_space(struct pfasta_parser *pp, const char *begin,
+                                   const char *end) {
+	if (pp->structure) return structure_find(pp, begin, end, 0);
+	return find_first_not_space(begin, end);
+}
+
+static inline size_t scan_newlines(struct pfasta_parser *pp, const char *begin,
+                                   const char *end) {
+	if (pp->structure) return structure_count_newlines(pp, begin, end);
+	return count_newlines(begin, end);
+}
+
+/** The flags that translate sequences. */
+#define TRANSFORM_FLAGS                                                        \
+	(PFASTA_UPPERCASE | PFASTA_ACGT | PFASTA_VALIDATE_IUPAC |                  \
+	 PFASTA_MASK_LOWERCASE)
+
+/** @brief Fill a translation table according to the transform flags. */
+static void transform_table(unsigned char *table, int flags) {
+	static const char iupac[] = "ACGTURYSWKMBDHVN-.";
+
+	for (int c = 0; c < 256; c++) {
+		int t = c;
+		if ((flags & PFASTA_VALIDATE_IUPAC) &&
+		    (!c || !strchr(iupac, toupper(c)))) {
+			table[c] = PFASTA_REJECT;
+			continue;
+		}
+		if ((flags & PFASTA_MASK_LOWERCASE) && islower(t)) t = 'N';
+		if (flags & PFASTA_UPPERCASE) t = toupper(t);
+		if ((flags & PFASTA_ACGT) && !memchr("ACGTacgt", t, 8)) {
+			t = PFASTA_DROP;
+		}
+		// Only validation rejects; the byte that marks it becomes '!'.
+		if (t == PFASTA_REJECT) t = '!';
+		table[c] = t;
+	}
+}
+
+int pfasta_set_table(struct pfasta_parser *pp, const unsigned char *table) {
+	if (!pp) return -1;
+
+	if (!table) {
+		free(pp->transform);
+		pp->transform = NULL;
+		return 0;
+	}
+
+	if (!pp->transform) {
+		pp->transform = malloc(sizeof(*pp->transform));
+		if (!pp->transform) return -1;
+	}
+
+	struct pfasta_transform *tf = pp->transform;
+	memcpy(tf->table, table, sizeof(tf->table));
+	memset(tf->keep, 0, sizeof(tf->keep));
+	memset(tf->fold, 0, sizeof(tf->fold));
+
+	for (int c = 1; c < 128; c++) {
+		if (table[c] == c) {
+			tf->keep[c & 15] |= 1 << (c >> 4);
+		} else if (c >= 0x20 && table[c] == c - 0x20 && table[c]) {
+			tf->fold[c & 15] |= 1 << (c >> 4);
+		}
+	}
+	return 0;
+}
+
+int pfasta_set_flags(struct pfasta_parser *pp, int flags) {
+	if (!pp) return -1;
+
+	int return_code = -1;
+	struct pfasta_structure *structure = pp->structure;
+	struct pfasta_transform *transform = pp->transform;
+
+	// Everything that can fail comes first, so that the parser is left as it
+	// was on error.
+	if ((flags & PFASTA_STRUCTURAL) && !structure) {
+		structure = malloc(sizeof(*structure));
+		if (!structure) goto cleanup;
+	}
+
+	if ((flags & TRANSFORM_FLAGS) && !transform) {
+		transform = malloc(sizeof(*transform));
+		if (!transform) goto cleanup;
+	}
+
+	// Only plain reads benefit; mapped files have the kernel's read-ahead.
+	if ((flags & PFASTA_READAHEAD) && pp->backend == BACKEND_READ &&
+	    !buffer_is_eof(pp)) {
+		if (readahead_init(pp)) goto cleanup;
+	}
+
+	if (flags & TRANSFORM_FLAGS) {
+		unsigned char table[256];
+		transform_table(table, flags);
+		pp->transform = transform;
+		pfasta_set_table(pp, table); // cannot fail, the memory is in place
+	} else if (pp->flags & TRANSFORM_FLAGS) {
+		pfasta_set_table(pp, NULL);
+	}
+
+	if (flags & PFASTA_STRUCTURAL) {
+		pp->structure = structure;
+		structure_invalidate(pp->structure);
+	} else {
+		free(pp->structure);
+		pp->structure = NULL;
+	}
+
+	pp->flags = flags;
+	return_code = 0;
+
+cleanup:
+	if (return_code) {
+		if (structure != pp->structure) free(structure);
+		if (transform != pp->transform) free(transform);
+	}
+	return return_code;
+}
+
+/** @brief Pick the widest kernels the CPU supports. */
+static void kernels_init(void) {
+#if PF_DISPATCH
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512bw")) {
+		find_first_space = find_first_space_avx512;
+		find_first_not_space = find_first_not_space_avx512;
+		count_newlines = count_newlines_avx512;
+		skip_residues = skip_residues_avx2;
+		classify = classify_avx512;
+		pack_blocks = pack_avx2;
+		translate = translate_avx2;
+	} else if (__builtin_cpu_supports("avx2")) {
+		find_first_space = find_first_space_avx2;
+		find_first_not_space = find_first_not_space_avx2;
+		count_newlines = count_newlines_avx2;
+		skip_residues = skip_residues_avx2;
+		classify = classify_avx2;
+		pack_blocks = pack_avx2;
+		translate = translate_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		find_first_space = find_first_space_sse2;
+		find_first_not_space = find_first_not_space_sse2;
+		count_newlines = count_newlines_sse2;
+		skip_residues = skip_residues_sse2;
+		classify = classify_sse2;
+		pack_blocks = pack_sse2;
+	}
+#endif
+}
+
+#if PFASTA_THREADSAFE
+static once_flag kernels_once = ONCE_FLAG_INIT;
+static void kernels_select(void) { call_once(&kernels_once, kernels_init); }
+#else
+static void kernels_select(void) {
+	static int selected = 0;
+	if (!selected) kernels_init();
+	selected = 1;
+}
+#endif
+
+/** @brief Stage two for sequences: copy complete lines from the classified
+ * window. This stops at anything unusual, like blank lines, CRLF, the end of
+ * the window or a new record, and leaves that to the general code. Afterwards,
+ * the parser points either to whitespace or to the start of a word.
+ */
+static int structure_copy_lines(struct pfasta_parser *pp, dynstr *sequence) {
+	int return_code = 0;
+	struct pfasta_structure *st = pp->structure;
+	const char *ptr = buffer_begin(pp);
+	size_t lines = 0;
+
+	structure_ensure(pp, ptr);
+	size_t length = st->limit - st->base;
+	size_t words = (length + 63) / 64;
+
+	while (1) {
+		size_t offset = ptr - st->base;
+		size_t word = offset / 64;
+		uint64_t bits = st->space[word] & (~0ULL << (offset % 64));
+
+		while (!bits && ++word < words) {
+			bits = st->space[word];
+		}
+		if (!bits) break;
+
+		size_t end_of_line = 64 * word + __builtin_ctzll(bits);
+		if (end_of_line >= length) break;
+
+		int check = sequence_append(pp, sequence, ptr,
+		                            st->base + end_of_line - ptr,
+		                            pp->line_number + lines);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+		ptr = st->base + end_of_line;
+
+		// Only continue for a single \n followed by more sequence.
+		size_t next = end_of_line + 1;
+		if (next >= length || !bit_at(st->newline, end_of_line)) break;
+		if (bit_at(st->space, next) || bit_at(st->header, next)) break;
+
+		char c = st->base[next];
+		if (!(isalpha(c) || c == '-' || c == '*')) break;
+
+		ptr = st->base + next;
+		lines++;
+	}
+
+	pp->read_ptr = (char *)ptr;
+	pp->line_number += lines;
+
+cleanup:
+	return return_code;
+}
+
+/** Lines are checked and copied in windows of this many bytes. */
+#define FIXED_WINDOW BUFFER_SIZE
+/** The width of a record whose lines are not all alike. */
+#define FIXED_NONE SIZE_MAX
+
+/** @brief Stage two for strictly formatted sequences: once the first line of
+ * a record has set the width, copy whole lines of that width as long as a
+ * newline follows each. Instead of searching every line for its end, only the
+ * expected newlines are looked at; a window of lines is copied at once and
+ * then checked for stray whitespace and bad line starts in one pass. Should
+ * the geometry break, as with CRLF, ragged or the short last line, the record
+ * is left to the general code. Afterwards, the parser points either to
+ * whitespace or to the start of a word.
+ *
+ * @param width - The line width of the record; zero if yet unknown.
+ */
+static int fixed_copy_lines(struct pfasta_parser *pp, dynstr *sequence,
+                            size_t *width) {
+	int return_code = 0;
+	const char *begin = buffer_begin(pp);
+	const char *end = buffer_end(pp);
+	const char *ptr = begin;
+	size_t lines = 0;
+
+	if (*width == 0) {
+		const char *end_of_line = find_first_space(begin, end);
+		if (end_of_line == end) return 0; // not in the buffer yet
+		if (*end_of_line != '\n') {
+			*width = FIXED_NONE;
+			return 0;
+		}
+
+		// The first line has been searched anyway, so take it right away.
+		*width = end_of_line - begin;
+		ptr = end_of_line + 1;
+		lines = 1;
+	}
+
+	size_t line_width = *width;
+	size_t stride = line_width + 1;
+	const char *first = ptr;
+	const char *window_end = end;
+	if ((size_t)(end - ptr) > FIXED_WINDOW) window_end = ptr + FIXED_WINDOW;
+
+	while ((size_t)(window_end - ptr) >= stride && ptr[line_width] == '\n') {
+		ptr += stride;
+	}
+	if ((size_t)(window_end - ptr) >= stride) *width = FIXED_NONE;
+
+	size_t full = (ptr - first) / stride;
+	lines += full;
+	if (lines == 0) return 0;
+
+	if (full == 0) {
+		// Just the first line; take it as the general code would.
+		int check = sequence_append(pp, sequence, begin, line_width,
+		                            pp->line_number);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+	} else {
+		size_t length = lines * line_width;
+		int check =
+		    sequence->borrow
+		        ? dynstr_unborrow(sequence, length, pp)
+		        : dynstr_reserve(sequence, sequence->count + length, pp);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+
+		char *target = sequence->str + sequence->count;
+		for (size_t i = 0; i < lines; i++) {
+			memcpy(target + i * line_width, begin + i * stride, line_width);
+		}
+		pp->stats.bytes_copied += length;
+
+		// The copy is cheaper to check than the input: it is contiguous and
+		// still in the cache.
+		// Lines up to the first bad one are kept; e.g. a following header may
+		// happen to have the width of the record.
+		size_t checked = lines - full;
+		const char *space =
+		    find_first_space(target + checked * line_width, target + length);
+		size_t good = (space - target) / line_width;
+		for (size_t i = checked; i < good; i++) {
+			char c = target[i * line_width];
+			if (!(isalpha(c) || c == '-' || c == '*')) good = i;
+		}
+		if (good < lines) {
+			*width = FIXED_NONE;
+			lines = good;
+			length = lines * line_width;
+			if (lines == 0) return 0;
+		}
+
+		if (pp->transform) {
+			// Translate in place. Errors are left to the general code,
+			// which knows the line of the offending residue.
+			int rejected = 0;
+			size_t count =
+			    translate(pp->transform, target, target, length, &rejected);
+			if (UNLIKELY(rejected)) {
+				*width = FIXED_NONE;
+				return 0;
+			}
+			length = count;
+		}
+
+		sequence->count += length;
+	}
+
+	// Stop on the last newline; the caller decides what comes after it.
+	pp->read_ptr = (char *)begin + lines * stride - 1;
+	pp->line_number += lines - 1;
+
+cleanup:
+	return return_code;
+}
+
+/** @brief Fail on the first residue in `str` that the transform rejects. */
+static int transform_reject(struct pfasta_parser *pp, const char *str,
+                            size_t line_number) {
+	int return_code = 0;
+	const unsigned char *table = pp->transform->table;
+
+	while (table[(unsigned char)*str] != PFASTA_REJECT) {
+		str++;
+	}
+	PF_FAIL_STR(pp, "Invalid residue '%c' on line %zu.", *str, line_number);
+
+cleanup:
+	return return_code;
+}
+
+/** @brief Append residues to a sequence, translating them on the way if the
+ * parser has a transform.
+ *
+ * @param line_number - The line the residues are from, for errors.
+ * @returns 0 iff successful.
+ */
+static int sequence_append(struct pfasta_parser *pp, dynstr *sequence,
+                           const char *str, size_t length,
+                           size_t line_number) {
+	int return_code = 0;
+
+	if (!pp->transform) return dynstr_append(sequence, str, length, pp);
+
+	assert(!sequence->borrow);
+	int check = dynstr_reserve(sequence, sequence->count + length, pp);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	int rejected = 0;
+	sequence->count += translate(pp->transform, sequence->str + sequence->count,
+	                             str, length, &rejected);
+	pp->stats.bytes_copied += length;
+	if (UNLIKELY(rejected)) {
+		check = transform_reject(pp, str, line_number);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+	}
+
+cleanup:
+	return return_code;
+}
+
+/** @brief Copy a word to `target`. Residues of a sequence are passed through
+ * the transform of the parser, if `residues` is set.
+ */
+static int copy_word(struct pfasta_parser *pp, dynstr *target, int residues) {
+	int return_code = 0;
+
+	int c;
+	while (c = buffer_peek(pp), c != EOF && LIKELY(!my_isspace(c))) {
+		char *end_of_word = scan_space(pp, buffer_begin(pp), buffer_end(pp));
+		size_t word_length = end_of_word - buffer_begin(pp);
+
+		assert(word_length > 0);
+
+		int check =
+		    residues ? sequence_append(pp, target, buffer_begin(pp),
+		                               word_length, pp->line_number)
+		             : dynstr_append(target, buffer_begin(pp), word_length, pp);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+
+		check = buffer_advance(pp, word_length);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+	}
+
+cleanup:
+	return return_code;
+}
+
+static int skip_whitespace(struct pfasta_parser *pp) {
+	int return_code = 0;
+
+	while (my_isspace(buffer_peek(pp))) {
+		char *split = scan_not_space(pp, buffer_begin(pp), buffer_end(pp));
+
+		// advance may clear the buffer. So count first …
+		size_t newlines = scan_newlines(pp, buffer_begin(pp), split);
+		int check = buffer_advance(pp, split - buffer_begin(pp));
+		// Trailing newlines are not part of any line number, but are lines.
+		if (check == E_EOF) pp->stats.lines = newlines;
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+
+		// … and then increase the counter.
+		pp->line_number += newlines;
+	}
+
+cleanup:
+	return return_code;
+}
+
+/** @brief Check that the input begins like a FASTA file. */
+static int parser_check_start(struct pfasta_parser *pp) {
+	int return_code = 0;
+
+	if (buffer_is_empty(pp) || buffer_is_eof(pp)) {
+		PF_FAIL_STR(pp, "File is empty.");
+	}
+
+	if (buffer_peek(pp) != '>') {
+		PF_FAIL_STR(pp, "File must start with '>'.");
+	}
+
+cleanup:
+	return return_code;
+}
+
+/** @brief Set up a parser on memory owned by someone else.
+ *
+ * @param begin - The start of the input.
+ * @param end - The end of the input.
+ * @param line_number - The line number of the first line of input.
+ */
+static struct pfasta_parser parser_init_range(const char *begin,
+                                              const char *end,
+                                              size_t line_number) {
+	int return_code = 0;
+	struct pfasta_parser pp = {0};
+	pp.line_number = line_number;
+
+	kernels_select();
+
+	pp.file_descriptor = -1;
+	pp.backend = BACKEND_MEMORY;
+	pp.buffer = pp.read_ptr = (char *)begin;
+	pp.fill_ptr = (char *)end;
+	pp.started = stats_clock();
+	pp.stats.bytes_read = end - begin;
+
+	int check = parser_check_start(&pp);
+	PF_FAIL_BUBBLE_CHECK(&pp, check);
+
+cleanup:
+	if (return_code) {
+		pfasta_free(&pp);
+	}
+	pp.done = return_code || buffer_is_eof(&pp);
+	return pp;
+}
+
+struct pfasta_parser pfasta_init(int file_descriptor) {
+	int return_code = 0;
+	struct pfasta_parser pp = {0};
+	pp.line_number = 1;
+
+	kernels_select();
+
+	pp.file_descriptor = file_descriptor;
+	pp.started = stats_clock();
+	int check = buffer_init(&pp);
+	if (check && check != E_EOF) PF_FAIL_BUBBLE_CHECK(&pp, check);
+
+	check = parser_check_start(&pp);
+	PF_FAIL_BUBBLE_CHECK(&pp, check);
+
+cleanup:
+	// free buffer if necessary
+	if (return_code) {
+		pfasta_free(&pp);
+	}
+	pp.done = return_code || buffer_is_eof(&pp);
+	return pp;
+}
+
+struct pfasta_parser pfasta_init_mem(const char *data, size_t length) {
+	return parser_init_range(data, data + length, 1);
+}
+
+struct pfasta_record pfasta_read(struct pfasta_parser *pp) {
+	int return_code = 0;
+	struct pfasta_record pr = {0};
+
+	// Most records have no comment, so only allocate for it on demand.
+	dynstr name, comment = {0}, sequence;
+	dynstr_init(&name, pp);
+	dynstr_init(&sequence, pp);
+	PF_FAIL_BUBBLE(pp);
+
+	int check = pfasta_read_name(pp, &name);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	int has_comment = 0;
+	check = pfasta_read_comment(pp, &comment, &has_comment);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	check = pfasta_read_sequence(pp, &sequence);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	pr.name_length = dynstr_len(&name);
+	pr.name = dynstr_move(&name);
+	pr.name_capacity = pr.name_length + 1;
+	if (has_comment) {
+		pr.comment_length = dynstr_len(&comment);
+		pr.comment = dynstr_move(&comment);
+		pr.comment_capacity = pr.comment_length + 1;
+	}
+	pr.sequence_length = dynstr_len(&sequence);
+	pr.sequence = dynstr_move(&sequence);
+	pr.sequence_capacity = pr.sequence_length + 1;
+
+cleanup:
+	dynstr_free(&name);
+	dynstr_free(&comment);
+	dynstr_free(&sequence);
+	if (return_code) {
+		pfasta_free(pp);
+	}
+	pp->done = return_code || buffer_is_eof(pp);
+	return pr;
+}
+
+int pfasta_read_into(struct pfasta_parser *pp, struct pfasta_record *pr) {
+	int return_code = 0;
+
+	dynstr name = {pr->name, pr->name_capacity, 0, NULL, 0};
+	dynstr comment = {pr->comment, pr->comment_capacity, 0, NULL, 0};
+	dynstr sequence = {pr->sequence, pr->sequence_capacity, 0, NULL, 0};
+
+	int check = pfasta_read_name(pp, &name);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	int has_comment = 0;
+	check = pfasta_read_comment(pp, &comment, &has_comment);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	check = pfasta_read_sequence(pp, &sequence);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	if (has_comment) {
+		// even an empty comment needs a string
+		check = dynstr_reserve(&comment, 0, pp);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+	} else {
+		dynstr_free(&comment);
+	}
+
+cleanup:
+	// Hand the memory back to the record, even on error.
+	pr->name = dynstr_terminate(&name);
+	pr->name_length = name.count;
+	pr->name_capacity = name.capacity;
+	pr->comment = dynstr_terminate(&comment);
+	pr->comment_length = comment.count;
+	pr->comment_capacity = comment.capacity;
+	pr->sequence = dynstr_terminate(&sequence);
+	pr->sequence_length = sequence.count;
+	pr->sequence_capacity = sequence.capacity;
+
+	if (return_code) {
+		pfasta_free(pp);
+	}
+	pp->done = return_code || buffer_is_eof(pp);
+	return return_code;
+}
+
+struct pfasta_view pfasta_read_view(struct pfasta_parser *pp) {
+	int return_code = 0;
+	struct pfasta_view pv = {0};
+
+	// Only memory that never gets refilled can be borrowed from.
+	int borrow = buffer_is_stable(pp);
+	dynstr_reset(&pp->scratch_name, borrow);
+	dynstr_reset(&pp->scratch_comment, borrow);
+	dynstr_reset(&pp->scratch_sequence, borrow && !pp->transform);
+
+	int check = pfasta_read_name(pp, &pp->scratch_name);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	int has_comment = 0;
+	check = pfasta_read_comment(pp, &pp->scratch_comment, &has_comment);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	check = pfasta_read_sequence(pp, &pp->scratch_sequence);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	pv.name = dynstr_span(&pp->scratch_name);
+	if (has_comment) {
+		pv.comment = dynstr_span(&pp->scratch_comment);
+	}
+	pv.sequence = dynstr_span(&pp->scratch_sequence);
+
+cleanup:
+	if (return_code) {
+		pfasta_free(pp);
+	}
+	pp->done = return_code || buffer_is_eof(pp);
+	return pv;
+}
+
+/** How far a parser got into a sequence that is read in chunks: not at all,
+ * right after the header, at the beginning of a line, or within a line.
+ */
+enum { CHUNK_NONE, CHUNK_START, CHUNK_LINE, CHUNK_WORD };
+
+/** @brief Mark a sequence read in chunks as complete. */
+static void chunk_finish(struct pfasta_parser *pp) {
+	if (pp->chunk_state != CHUNK_NONE) {
+		PF_PROBE2(record_end, pp, pp->line_number);
+	}
+	pp->chunk_state = CHUNK_NONE;
+}
+
+struct pfasta_view pfasta_read_header(struct pfasta_parser *pp) {
+	int return_code = 0;
+	struct pfasta_view pv = {0};
+
+	// Skip whatever is left of the previous sequence.
+	if (pp->chunk_state != CHUNK_NONE) {
+		size_t skipped;
+		int check = chunk_skip(pp, &skipped);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+
+		// That was the last record.
+		if (buffer_is_eof(pp)) {
+			pp->done = 1;
+			return pv;
+		}
+	}
+
+	int borrow = buffer_is_stable(pp);
+	dynstr_reset(&pp->scratch_name, borrow);
+	dynstr_reset(&pp->scratch_comment, borrow);
+
+	int check = pfasta_read_name(pp, &pp->scratch_name);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	int has_comment = 0;
+	check = pfasta_read_comment(pp, &pp->scratch_comment, &has_comment);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	pv.name = dynstr_span(&pp->scratch_name);
+	if (has_comment) {
+		pv.comment = dynstr_span(&pp->scratch_comment);
+	}
+	pp->chunk_state = CHUNK_START;
+
+cleanup:
+	if (return_code) {
+		pfasta_free(pp);
+		pp->chunk_state = CHUNK_NONE;
+	}
+	// The sequence is still to come.
+	pp->done = return_code;
+	return pv;
+}
+
+/** Memory-mapped input is given back in steps of this size, while reading a
+ * sequence in chunks. It is a multiple of any page size.
+ */
+#define RELEASE_SIZE (16 << 20)
+
+/** @brief Drop the pages of a mapping that the parser has passed. They would
+ * otherwise add up to the size of the file, even though a sequence read in
+ * chunks is never held in memory. The pages are read again, should a borrowed
+ * name point into them.
+ */
+static void chunk_release(struct pfasta_parser *pp) {
+#ifdef MADV_DONTNEED
+	size_t offset = pp->read_ptr - pp->buffer;
+	if (offset < pp->released + RELEASE_SIZE) return;
+
+	size_t end = offset / RELEASE_SIZE * RELEASE_SIZE;
+	(void)madvise(pp->buffer + pp->released, end - pp->released,
+	              MADV_DONTNEED);
+	pp->released = end;
+#else
+	(void)pp;
+#endif
+}
+
+/** @brief Copy up to `size` residues of the current sequence to `buffer`, or
+ * just skip them if `buffer` is NULL. This follows `pfasta_read_sequence`, but
+ * can stop anywhere and resume later.
+ *
+ * @param count - Set to the number of residues.
+ * @returns 0 iff successful.
+ */
+static int chunk_read(struct pfasta_parser *pp, char *buffer, size_t size,
+                      size_t *count) {
+	int return_code = 0;
+	int check;
+	*count = 0;
+
+	if (pp->chunk_state == CHUNK_START) {
+		assert(buffer_peek(pp) == '\n');
+
+		check = skip_whitespace(pp);
+		if (check == E_EOF)
+			PF_FAIL_STR(pp, "Empty sequence on line %zu.", pp->line_number);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+
+		int c = buffer_peek(pp);
+		if (!(isalpha(c) || c == '-' || c == '*'))
+			PF_FAIL_STR(pp, "Empty sequence on line %zu.", pp->line_number);
+		pp->chunk_state = CHUNK_WORD;
+	}
+
+	while (pp->chunk_state != CHUNK_NONE && *count < size) {
+		if (pp->chunk_state == CHUNK_LINE) {
+			// Assume a line begins only with alpha, -, *, or more spaces
+			int c = buffer_peek(pp);
+			if (!(isalpha(c) || c == '-' || c == '*')) {
+				chunk_finish(pp);
+				break;
+			}
+			pp->chunk_state = CHUNK_WORD;
+		}
+
+		char *begin = buffer_begin(pp);
+		char *end_of_word = scan_space(pp, begin, buffer_end(pp));
+		size_t length = end_of_word - begin;
+		if (length > size - *count) length = size - *count;
+
+		if (!buffer) {
+			*count += length;
+		} else if (!pp->transform) {
+			memcpy(buffer + *count, begin, length);
+			*count += length;
+			pp->stats.bytes_copied += length;
+		} else {
+			int rejected = 0;
+			*count += translate(pp->transform, buffer + *count, begin, length,
+			                    &rejected);
+			pp->stats.bytes_copied += length;
+			if (UNLIKELY(rejected)) {
+				check = transform_reject(pp, begin, pp->line_number);
+				PF_FAIL_BUBBLE_CHECK(pp, check);
+			}
+		}
+
+		check = buffer_advance(pp, length);
+		if (UNLIKELY(check == E_EOF)) break;
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+
+		if (!my_isspace(buffer_peek(pp))) continue;
+
+		// optimize for more common case
+		ptrdiff_t available = buffer_end(pp) - buffer_begin(pp);
+		if (LIKELY(available >= 2 && buffer_begin(pp)[0] == '\n' &&
+		           buffer_begin(pp)[1] > ' ')) {
+			pp->read_ptr++;
+			pp->line_number += 1;
+		} else {
+			check = skip_whitespace(pp);
+			if (UNLIKELY(check == E_EOF)) break;
+			PF_FAIL_BUBBLE_CHECK(pp, check);
+		}
+		pp->chunk_state = CHUNK_LINE;
+	}
+
+	if (buffer_is_eof(pp)) {
+		chunk_finish(pp);
+		pp->errstr = NULL; // reset error
+	} else if (pp->backend == BACKEND_MMAP) {
+		chunk_release(pp);
+	}
+
+cleanup:
+	return return_code;
+}
+
+size_t pfasta_read_chunk(struct pfasta_parser *pp, char *buffer, size_t size) {
+	int return_code = 0;
+	size_t count = 0;
+	PF_FAIL_BUBBLE(pp);
+
+	int check = chunk_read(pp, buffer, size, &count);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+cleanup:
+	if (return_code) {
+		pfasta_free(pp);
+		chunk_finish(pp);
+		count = 0;
+	}
+	pp->done = return_code ||
+	           (pp->chunk_state == CHUNK_NONE && buffer_is_eof(pp));
+	return count;
+}
+
+/** @brief Skip the rest of the current sequence without copying it. The
+ * residues and newlines are counted window by window, so that this runs at the
+ * speed of a vectorised popcount.
+ *
+ * @param count - Set to the number of residues skipped.
+ * @returns 0 iff successful.
+ */
+static int chunk_skip(struct pfasta_parser *pp, size_t *count) {
+	int return_code = 0;
+	int check;
+	*count = 0;
+
+	if (pp->chunk_state == CHUNK_START) {
+		// Let the chunk reader check that there is a sequence at all.
+		check = chunk_read(pp, NULL, 0, count);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+	}
+
+	int after_space = pp->chunk_state == CHUNK_LINE;
+	while (pp->chunk_state != CHUNK_NONE) {
+		const char *begin = buffer_begin(pp);
+		const char *end = buffer_end(pp);
+		// Go through a mapping in steps, so that passed pages can be released.
+		if (end - begin > RELEASE_SIZE) end = begin + RELEASE_SIZE;
+
+		const char *stop;
+		size_t newlines = 0;
+		*count += skip_residues(begin, end, &after_space, &newlines, &stop);
+		pp->line_number += newlines;
+
+		if (stop < end) {
+			pp->read_ptr = (char *)stop;
+			chunk_finish(pp);
+			break;
+		}
+
+		check = buffer_advance(pp, end - begin);
+		if (check == E_EOF) {
+			chunk_finish(pp);
+			pp->errstr = NULL; // reset error
+			break;
+		}
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+
+		if (pp->backend == BACKEND_MMAP) chunk_release(pp);
+	}
+
+cleanup:
+	return return_code;
+}
+
+size_t pfasta_skip_sequence(struct pfasta_parser *pp) {
+	int return_code = 0;
+	size_t count = 0;
+	PF_FAIL_BUBBLE(pp);
+
+	int check = chunk_skip(pp, &count);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+cleanup:
+	if (return_code) {
+		pfasta_free(pp);
+		pp->chunk_state = CHUNK_NONE;
+		count = 0;
+	}
+	pp->done = return_code || buffer_is_eof(pp);
+	return count;
+}
+
+/** Packed sequences are read through a small staging buffer, which stays in
+ * the L1 cache. Its size is a multiple of 32, so that every chunk but the last
+ * fills whole words.
+ */
+#define PACK_STAGING 4096
+
+#define EVEN_BITS 0x5555555555555555ULL
+
+/** @brief Move bit i of `mask` to bit 2i. */
+static inline uint64_t spread_bits(uint32_t mask) {
+	uint64_t x = mask;
+	x = (x | x << 16) & 0x0000FFFF0000FFFFULL;
+	x = (x | x << 8) & 0x00FF00FF00FF00FFULL;
+	x = (x | x << 4) & 0x0F0F0F0F0F0F0F0FULL;
+	x = (x | x << 2) & 0x3333333333333333ULL;
+	x = (x | x << 1) & EVEN_BITS;
+	return x;
+}
+
+/** @brief Add position `start` with character `base` to a list of runs,
+ * extending the last run if possible.
+ *
+ * @returns 0 iff successful.
+ */
+static int run_append(struct pfasta_run **runs, size_t *count,
+                      size_t *capacity, size_t start, size_t length,
+                      char base) {
+	struct pfasta_run *last = *count ? &(*runs)[*count - 1] : NULL;
+	if (last && last->start + last->length == start && last->base == base) {
+		last->length += length;
+		return 0;
+	}
+
+	if (*count == *capacity) {
+		size_t neu_capacity = *capacity ? *capacity * 2 : 16;
+		struct pfasta_run *neu =
+		    pfasta_reallocarray(*runs, neu_capacity, sizeof(*neu));
+		if (!neu) return -1;
+		*runs = neu;
+		*capacity = neu_capacity;
+	}
+
+	(*runs)[(*count)++] = (struct pfasta_run){start, length, base};
+	return 0;
+}
+
+/** @brief Index of the first run that ends after `position`. */
+static size_t run_find(const struct pfasta_run *runs, size_t count,
+                       size_t position) {
+	size_t low = 0, high = count;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (runs[mid].start + runs[mid].length <= position) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+/** @brief Bit mask of the positions of word `word` covered by runs. The
+ * cursor has to start at zero and words must be visited in order.
+ */
+static uint32_t run_bits(const struct pfasta_run *runs, size_t count,
+                         size_t *cursor, size_t word) {
+	size_t begin = word * 32, end = begin + 32;
+	uint32_t bits = 0;
+
+	while (*cursor < count && runs[*cursor].start + runs[*cursor].length <=
+	                              begin) {
+		++*cursor;
+	}
+
+	for (size_t r = *cursor; r < count && runs[r].start < end; r++) {
+		size_t from = runs[r].start > begin ? runs[r].start : begin;
+		size_t to = runs[r].start + runs[r].length;
+		if (to > end) to = end;
+
+		uint64_t ones = (1ULL << (to - from)) - 1;
+		bits |= (uint32_t)(ones << (from - begin));
+	}
+
+	return bits;
+}
+
+/** @brief Append `count` characters to a packed sequence, whose length must be
+ * a multiple of 32, and at most PACK_STAGING at a time.
+ *
+ * @returns 0 iff successful.
+ */
+static int pack_append(struct pfasta_packed *pk, const char *data,
+                       size_t count) {
+	assert(pk->length % 32 == 0 && count <= PACK_STAGING);
+
+	size_t first = pk->length / 32;
+	size_t blocks = (count + 31) / 32;
+	if (first + blocks > pk->word_capacity) {
+		size_t capacity = pk->word_capacity ? pk->word_capacity : 64;
+		while (capacity < first + blocks) capacity *= 2;
+
+		uint64_t *neu = pfasta_reallocarray(pk->words, capacity, sizeof(*neu));
+		if (!neu) return -1;
+		pk->words = neu;
+		pk->word_capacity = capacity;
+	}
+
+	uint32_t exception[PACK_STAGING / 32], lower[PACK_STAGING / 32];
+	size_t full = count / 32, rest = count % 32;
+	pack_blocks(data, full, pk->words + first, exception, lower);
+	if (rest) {
+		// Pad with A, which is neither an exception nor lower case.
+		char block[32];
+		memset(block, 'A', sizeof(block));
+		memcpy(block, data + 32 * full, rest);
+		pack_blocks(block, 1, pk->words + first + full, exception + full,
+		            lower + full);
+	}
+
+	for (size_t k = 0; k < blocks; k++) {
+		size_t offset = pk->length + 32 * k;
+
+		uint32_t e = exception[k];
+		if (UNLIKELY(e)) {
+			// Exceptions are coded as A.
+			pk->words[first + k] &= ~(spread_bits(e) * 3);
+			for (; e; e &= e - 1) {
+				size_t i = __builtin_ctz(e);
+				unsigned char c = data[32 * k + i];
+				if (c >= 'a' && c <= 'z') c &= 0xDF;
+				if (run_append(&pk->exceptions, &pk->exception_count,
+				               &pk->exception_capacity, offset + i, 1, c)) {
+					return -1;
+				}
+			}
+		}
+
+		uint64_t l = lower[k];
+		while (l) {
+			size_t i = __builtin_ctzll(l);
+			size_t length = __builtin_ctzll(~(l >> i));
+			if (run_append(&pk->masks, &pk->mask_count, &pk->mask_capacity,
+			               offset + i, length, 0)) {
+				return -1;
+			}
+			l &= ~(((1ULL << length) - 1) << i);
+		}
+	}
+
+	pk->length += count;
+	return 0;
+}
+
+int pfasta_read_packed(struct pfasta_parser *pp, struct pfasta_packed *pk) {
+	int return_code = 0;
+	char staging[PACK_STAGING];
+
+	pk->length = 0;
+	pk->exception_count = 0;
+	pk->mask_count = 0;
+	PF_FAIL_BUBBLE(pp);
+
+	while (1) {
+		size_t count;
+		int check = chunk_read(pp, staging, sizeof(staging), &count);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+		if (count == 0) break;
+
+		if (pack_append(pk, staging, count)) PF_FAIL_ERRNO(pp);
+	}
+
+cleanup:
+	if (return_code) {
+		pfasta_free(pp);
+		pp->chunk_state = CHUNK_NONE;
+	}
+	pp->done = return_code ||
+	           (pp->chunk_state == CHUNK_NONE && buffer_is_eof(pp));
+	return return_code;
+}
+
+size_t pfasta_packed_unpack(const struct pfasta_packed *pk, size_t start,
+                            size_t end, char *buffer) {
+	static const char bases[] = "ACTG";
+	if (end > pk->length) end = pk->length;
+	if (start >= end) return 0;
+
+	for (size_t i = start; i < end; i++) {
+		buffer[i - start] = bases[(pk->words[i / 32] >> (2 * (i % 32))) & 3];
+	}
+
+	size_t r = run_find(pk->exceptions, pk->exception_count, start);
+	for (; r < pk->exception_count && pk->exceptions[r].start < end; r++) {
+		const struct pfasta_run *run = &pk->exceptions[r];
+		size_t from = run->start > start ? run->start : start;
+		size_t to = run->start + run->length < end ? run->start + run->length
+		                                           : end;
+		memset(buffer + from - start, run->base, to - from);
+	}
+
+	r = run_find(pk->masks, pk->mask_count, start);
+	for (; r < pk->mask_count && pk->masks[r].start < end; r++) {
+		const struct pfasta_run *run = &pk->masks[r];
+		size_t from = run->start > start ? run->start : start;
+		size_t to = run->start + run->length < end ? run->start + run->length
+		                                           : end;
+		for (size_t i = from; i < to; i++) {
+			buffer[i - start] |= 0x20;
+		}
+	}
+
+	return end - start;
+}
+
+/** @brief The IUPAC complement of an exception. */
+static char complement_iupac(char c) {
+	switch (c) {
+	case 'R': return 'Y';
+	case 'Y': return 'R';
+	case 'K': return 'M';
+	case 'M': return 'K';
+	case 'B': return 'V';
+	case 'V': return 'B';
+	case 'D': return 'H';
+	case 'H': return 'D';
+	case 'U': return 'A';
+	default: return c;
+	}
+}
+
+void pfasta_packed_complement(struct pfasta_packed *pk) {
+	size_t words = (pk->length + 31) / 32;
+	for (size_t k = 0; k < words; k++) {
+		pk->words[k] ^= ~EVEN_BITS;
+	}
+
+	// Keep the padding and the exceptions at zero.
+	if (pk->length % 32) {
+		pk->words[words - 1] &= (1ULL << (2 * (pk->length % 32))) - 1;
+	}
+
+	size_t cursor = 0;
+	for (size_t k = 0; k < words; k++) {
+		uint32_t e = run_bits(pk->exceptions, pk->exception_count, &cursor, k);
+		pk->words[k] &= ~(spread_bits(e) * 3);
+	}
+
+	for (size_t r = 0; r < pk->exception_count; r++) {
+		pk->exceptions[r].base = complement_iupac(pk->exceptions[r].base);
+	}
+}
+
+size_t pfasta_packed_gc(const struct pfasta_packed *pk) {
+	size_t gc = 0;
+	size_t words = (pk->length + 31) / 32;
+
+	// C and G have the low bit set; exceptions and padding are zero.
+	for (size_t k = 0; k < words; k++) {
+		gc += __builtin_popcountll(pk->words[k] & EVEN_BITS);
+	}
+
+	return gc;
+}
+
+size_t pfasta_packed_mismatches(const struct pfasta_packed *a,
+                                const struct pfasta_packed *b) {
+	size_t length = a->length < b->length ? a->length : b->length;
+	size_t words = (length + 31) / 32;
+	size_t mismatches = 0;
+	size_t cursor_ea = 0, cursor_eb = 0, cursor_ma = 0, cursor_mb = 0;
+
+	for (size_t k = 0; k < words; k++) {
+		uint64_t x = a->words[k] ^ b->words[k];
+		uint64_t diff = (x | x >> 1) & EVEN_BITS;
+
+		uint32_t ea = run_bits(a->exceptions, a->exception_count, &cursor_ea, k);
+		uint32_t eb = run_bits(b->exceptions, b->exception_count, &cursor_eb, k);
+		uint32_t ma = run_bits(a->masks, a->mask_count, &cursor_ma, k);
+		uint32_t mb = run_bits(b->masks, b->mask_count, &cursor_mb, k);
+
+		uint32_t valid = ~0U;
+		if (k == words - 1 && length % 32) valid = (1U << (length % 32)) - 1;
+
+		uint32_t special = (ea | eb) & valid;
+		diff |= spread_bits(ma ^ mb);
+		diff &= spread_bits(valid & ~special);
+		mismatches += __builtin_popcountll(diff);
+
+		if (UNLIKELY(special)) {
+			// Compare the exceptions character by character.
+			char ca[32], cb[32];
+			pfasta_packed_unpack(a, 32 * k, 32 * k + 32, ca);
+			pfasta_packed_unpack(b, 32 * k, 32 * k + 32, cb);
+			for (; special; special &= special - 1) {
+				size_t i = __builtin_ctz(special);
+				mismatches += ca[i] != cb[i];
+			}
+		}
+	}
+
+	return mismatches;
+}
+
+void pfasta_packed_free(struct pfasta_packed *pk) {
+	if (!pk) return;
+	free(pk->words);
+	free(pk->exceptions);
+	free(pk->masks);
+	*pk = (struct pfasta_packed){0};
+}
+
+/** @brief Append a string and its terminating null byte to the arena. */
+static int batch_append(dynstr *arena, struct pfasta_span span,
+                        struct pfasta_parser *pp) {
+	int return_code = 0;
+
+	int check = dynstr_append(arena, span.data, span.length, pp);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	check = dynstr_append(arena, "", 1, pp);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+cleanup:
+	return return_code;
+}
+
+struct pfasta_batch pfasta_read_batch(struct pfasta_parser *pp,
+                                      size_t max_records, size_t max_bytes) {
+	int return_code = 0;
+	struct pfasta_batch pb = {0};
+	size_t capacity = 0;
+
+	// All strings go into one arena. It may move while growing, so the
+	// pointers are only set up once the batch is complete.
+	dynstr arena = {0};
+
+	while (!pp->done && (!max_records || pb.count < max_records) &&
+	       (!max_bytes || dynstr_len(&arena) < max_bytes)) {
+		struct pfasta_view pv = pfasta_read_view(pp);
+		PF_FAIL_BUBBLE(pp);
+
+		if (pb.count == capacity) {
+			capacity = capacity ? capacity / 2 * 3 : 16;
+			struct pfasta_record *records =
+			    pfasta_reallocarray(pb.records, capacity, sizeof(*records));
+			if (!records) PF_FAIL_ERRNO(pp);
+			pb.records = records;
+		}
+
+		int check = batch_append(&arena, pv.name, pp);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+		if (pv.comment.data) {
+			check = batch_append(&arena, pv.comment, pp);
+			PF_FAIL_BUBBLE_CHECK(pp, check);
+		}
+		check = batch_append(&arena, pv.sequence, pp);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+
+		// For now, the comment pointer only tells whether there is one.
+		pb.records[pb.count++] = (struct pfasta_record){
+		    .comment = (char *)pv.comment.data,
+		    .name_length = pv.name.length,
+		    .comment_length = pv.comment.length,
+		    .sequence_length = pv.sequence.length,
+		};
+	}
+
+cleanup:
+	// Should the arena have failed to grow, it is gone with all strings.
+	if (!arena.str) pb.count = 0;
+
+	pb.arena = arena.str;
+	char *ptr = pb.arena;
+	for (size_t i = 0; i < pb.count; i++) {
+		struct pfasta_record *pr = &pb.records[i];
+		pr->name = ptr;
+		ptr += pr->name_length + 1;
+		if (pr->comment) {
+			pr->comment = ptr;
+			ptr += pr->comment_length + 1;
+		}
+		pr->sequence = ptr;
+		ptr += pr->sequence_length + 1;
+	}
+
+	if (return_code) {
+		pfasta_free(pp);
+	}
+	pp->done = return_code || buffer_is_eof(pp);
+	return pb;
+}
+
+int pfasta_read_name(struct pfasta_parser *pp, dynstr *name) {
+	int return_code = 0;
+	PF_PROBE2(record_start, pp, pp->line_number);
+
+	assert(!buffer_is_empty(pp));
+	if (buffer_peek(pp) != '>') {
+		PF_FAIL_STR(pp, "Expected '>' but found '%c' on line %zu.",
+		            buffer_peek(pp), pp->line_number);
+	}
+
+	int check = buffer_advance(pp, 1); // skip >
+	if (check == E_EOF)
+		PF_FAIL_STR(pp, "Unexpected EOF in name on line %zu.", pp->line_number);
+	PF_FAIL_BUBBLE(pp);
+
+	check = copy_word(pp, name, 0);
+	if (check == E_EOF)
+		PF_FAIL_STR(pp, "Unexpected EOF in name on line %zu.", pp->line_number);
+	PF_FAIL_BUBBLE(pp);
+
+	if (dynstr_len(name) == 0)
+		PF_FAIL_STR(pp, "Empty name on line %zu.", pp->line_number);
+
+	pp->stats.records++;
+
+cleanup:
+	return return_code;
+}
+
+int pfasta_read_comment(struct pfasta_parser *pp, dynstr *comment,
+                        int *has_comment) {
+	int return_code = 0;
+
+	if (buffer_peek(pp) == '\n') {
+		*has_comment = 0;
+		return 0;
+	}
+
+	*has_comment = 1;
+	assert(!buffer_is_empty(pp));
+
+	int check = buffer_advance(pp, 1); // skip first whitespace
+	if (check == E_EOF) goto label_eof;
+	PF_FAIL_BUBBLE(pp);
+
+	assert(!buffer_is_empty(pp));
+
+	// get comment, one buffer worth at a time
+	while (1) {
+		char *begin = buffer_begin(pp);
+		size_t available = buffer_end(pp) - begin;
+		char *end_of_line = memchr(begin, '\n', available);
+		size_t length = end_of_line ? (size_t)(end_of_line - begin) : available;
+
+		check = dynstr_append(comment, begin, length, pp);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+
+		// does not refill if the newline is in the buffer
+		check = buffer_advance(pp, length);
+		if (check == E_EOF) goto label_eof;
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+
+		if (end_of_line) break;
+	}
+
+label_eof:
+	if (buffer_is_eof(pp))
+		PF_FAIL_STR(pp, "Unexpected EOF in comment on line %zu.",
+		            pp->line_number);
+
+cleanup:
+	return return_code;
+}
+
+int pfasta_read_sequence(struct pfasta_parser *pp, dynstr *sequence) {
+	int return_code = 0;
+
+	assert(!buffer_is_empty(pp));
+	assert(!buffer_is_eof(pp));
+	assert(buffer_peek(pp) == '\n');
 
 	int check = skip_whitespace(pp);
 	if (check == E_EOF)
 		PF_FAIL_STR(pp, "Empty sequence on line %zu.", pp->line_number);
 	PF_FAIL_BUBBLE_CHECK(pp, check);
 
-	// Assume a line begins only with alpha, -, *, or more spaces
-	char c;
-	while (c = buffer_peek(pp), LIKELY(isalpha(c) || c == '-' || c == '*')) {
-		int check = copy_word(pp, &sequence);
-		if (UNLIKELY(check == E_EOF)) break;
-		PF_FAIL_BUBBLE_CHECK(pp, check);
+	// Assume a line begins only with alpha, -, *, or more spaces
+	char c;
+	int empty = 1; // a transform may have dropped all residues
+	size_t width = 0;
+	while (c = buffer_peek(pp), LIKELY(isalpha(c) || c == '-' || c == '*')) {
+		empty = 0;
+		if (pp->structure) {
+			int check = structure_copy_lines(pp, sequence);
+			PF_FAIL_BUBBLE_CHECK(pp, check);
+		} else if (width != FIXED_NONE) {
+			int check = fixed_copy_lines(pp, sequence, &width);
+			PF_FAIL_BUBBLE_CHECK(pp, check);
+		}
+
+		int check = copy_word(pp, sequence, 1);
+		if (UNLIKELY(check == E_EOF)) break;
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+
+		// optimize for more common case
+		ptrdiff_t length = buffer_end(pp) - buffer_begin(pp);
+		if (LIKELY(length >= 2 && buffer_begin(pp)[0] == '\n' &&
+		           buffer_begin(pp)[1] > ' ')) {
+			pp->read_ptr++; // nasty hack
+			pp->line_number += 1;
+		} else {
+			check = skip_whitespace(pp);
+			if (UNLIKELY(check == E_EOF)) break;
+			PF_FAIL_BUBBLE_CHECK(pp, check);
+		}
+	}
+
+	if (empty)
+		PF_FAIL_STR(pp, "Empty sequence on line %zu.", pp->line_number);
+
+	pp->errstr = NULL; // reset error
+	PF_PROBE2(record_end, pp, pp->line_number);
+
+cleanup:
+	return return_code;
+}
+
+void pfasta_record_free(struct pfasta_record *pr) {
+	if (!pr) return;
+	free(pr->name);
+	free(pr->comment);
+	free(pr->sequence);
+	pr->name = pr->comment = pr->sequence = NULL;
+	pr->name_capacity = pr->comment_capacity = pr->sequence_capacity = 0;
+}
+
+void pfasta_batch_free(struct pfasta_batch *pb) {
+	if (!pb) return;
+	free(pb->records);
+	free(pb->arena);
+	*pb = (struct pfasta_batch){0};
+}
+
+struct pfasta_stats pfasta_get_stats(const struct pfasta_parser *pp) {
+	struct pfasta_stats stats = pp->stats;
+
+	// Whatever is left in the buffer has not been consumed, yet.
+	size_t left = buffer_is_eof(pp) ? 0 : pp->fill_ptr - pp->read_ptr;
+	stats.bytes = stats.bytes_read > left ? stats.bytes_read - left : 0;
+	stats.lines += pp->line_number ? pp->line_number - 1 : 0;
+	stats.elapsed_nanoseconds = stats_clock() - pp->started;
+	return stats;
+}
+
+void pfasta_free(struct pfasta_parser *pp) {
+	if (!pp) return;
+	if (pp->backend == BACKEND_MMAP) {
+		if (pp->buffer) munmap(pp->buffer, pp->mapped_length);
+		pp->mapped_length = 0;
+	} else if (pp->backend == BACKEND_READ) {
+		free(pp->buffer);
+	} else if (pp->backend == BACKEND_GZIP) {
+		inflate_free(pp->inflate);
+		pp->inflate = NULL;
+	} else if (pp->backend == BACKEND_READAHEAD) {
+		readahead_free(pp->readahead);
+		pp->readahead = NULL;
+	} else if (pp->backend == BACKEND_URING && pp->uring) {
+		uring_release(pp->uring);
+		pp->uring = NULL;
+	}
+	pp->buffer = NULL;
+
+	if (pp->owns_descriptor) {
+		close(pp->file_descriptor);
+		pp->owns_descriptor = 0;
+	}
+
+	free(pp->structure);
+	pp->structure = NULL;
+	free(pp->transform);
+	pp->transform = NULL;
+
+	dynstr_free(&pp->scratch_name);
+	dynstr_free(&pp->scratch_comment);
+	dynstr_free(&pp->scratch_sequence);
+}
+
+/** @brief Creates a new string that can grow dynamically.
+ *
+ * @param ds - A reference to the dynstr container.
+ *
+ * @returns 0 iff successful.
+ */
+static inline int dynstr_init(dynstr *ds, struct pfasta_parser *pp) {
+	int return_code = 0;
+
+	*ds = (dynstr){0};
+	ds->str = malloc(DYNSTR_INITIAL_CAPACITY);
+	if (!ds->str) PF_FAIL_ERRNO(pp);
+
+	ds->str[0] = '\0';
+	ds->capacity = DYNSTR_INITIAL_CAPACITY;
+	ds->count = 0;
+
+cleanup:
+	return return_code;
+}
+
+/** @brief Empties a string but keeps its memory for reuse.
+ *
+ * @param ds - A reference to the dynstr container.
+ * @param borrow - Iff set, appended data may be referenced instead of copied.
+ */
+static inline void dynstr_reset(dynstr *ds, int borrow) {
+	ds->count = 0;
+	ds->borrowed = NULL;
+	ds->borrow = borrow;
+}
+
+/** @brief Copy borrowed characters into owned memory. */
+static int dynstr_unborrow(dynstr *ds, size_t extra, struct pfasta_parser *pp) {
+	int return_code = 0;
+	const char *borrowed = ds->borrowed;
+	size_t count = ds->count;
+
+	ds->borrowed = NULL;
+	ds->borrow = 0;
+	ds->count = 0;
+
+	int check = dynstr_reserve(ds, count + extra, pp);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	if (count) memcpy(ds->str, borrowed, count);
+	ds->count = count;
+	pp->stats.bytes_copied += count;
+
+cleanup:
+	return return_code;
+}
+
+/** @brief Make sure that at least `required + 1` bytes can be stored.
+ *
+ * @returns 0 iff successful.
+ */
+static inline int dynstr_reserve(dynstr *ds, size_t required,
+                                 struct pfasta_parser *pp) {
+	int return_code = 0;
+
+	if (UNLIKELY(required >= ds->capacity)) {
+		// Grow by a factor of 1.5 plus some slack, so that tiny strings do
+		// not get reallocated on every append.
+		size_t half = required / 2 + DYNSTR_INITIAL_CAPACITY / 3;
+		char *neu = pfasta_reallocarray(ds->str, half, 3);
+		if (UNLIKELY(!neu)) {
+			dynstr_free(ds);
+			PF_FAIL_ERRNO(pp);
+		}
+		PF_PROBE3(dynstr_grow, pp, ds->capacity, half * 3);
+		ds->str = neu;
+		ds->capacity = half * 3;
+		pp->stats.reallocs++;
+	}
+
+cleanup:
+	return return_code;
+}
+
+/** @brief A append more than one character to a string.
+ *
+ * @param ds - A reference to the dynstr container.
+ * @param str - The new characters.
+ * @param length - number of new characters to append
+ *
+ * @returns 0 iff successful.
+ */
+static inline int dynstr_append(dynstr *ds, const char *str, size_t length,
+                                struct pfasta_parser *pp) {
+	int return_code = 0;
+	int check;
+
+	if (UNLIKELY(ds->borrow)) {
+		// Keep referencing the input as long as it is contiguous.
+		if (ds->count == 0 || ds->borrowed + ds->count == str) {
+			if (ds->count == 0) ds->borrowed = str;
+			ds->count += length;
+			return 0;
+		}
+
+		check = dynstr_unborrow(ds, length, pp);
+		PF_FAIL_BUBBLE_CHECK(pp, check);
+	}
+
+	size_t required = ds->count + length;
+
+	check = dynstr_reserve(ds, required, pp);
+	PF_FAIL_BUBBLE_CHECK(pp, check);
+
+	memcpy(ds->str + ds->count, str, length);
+	ds->count = required;
+	pp->stats.bytes_copied += length;
+
+cleanup:
+	return return_code;
+}
+
+/** @brief Frees a dynamic string. */
+static inline void dynstr_free(dynstr *ds) {
+	if (!ds) return;
+	free(ds->str);
+	*ds = (dynstr){0};
+}
+
+/** @brief Returns the string as a standard `char*`. The internal reference is
+ * then deleted. Hence the name *move* as in *move semantics*.
+ *
+ * @param ds - The dynamic string to move from.
+ *
+ * @returns a `char*` to a standard null-terminated string.
+ */
+static inline char *dynstr_move(dynstr *ds) {
+	char *out = pfasta_reallocarray(ds->str, ds->count + 1, 1);
+	if (!out) {
+		out = ds->str;
+		if (!out) return NULL;
+	}
+	out[ds->count] = '\0';
+	*ds = (dynstr){0};
+	return out;
+}
+
+/** @brief Null-terminates an owned string and returns it, if there is one. */
+static inline char *dynstr_terminate(dynstr *ds) {
+	if (ds->count < ds->capacity) ds->str[ds->count] = '\0';
+	return ds->str;
+}
+
+/** @brief Returns a view of the current content without giving up ownership.
+ * Owned content is null-terminated, borrowed content is not.
+ */
+static inline struct pfasta_span dynstr_span(dynstr *ds) {
+	if (ds->borrowed) {
+		return (struct pfasta_span){ds->borrowed, ds->count};
+	}
+	if (!ds->str) {
+		return (struct pfasta_span){"", 0};
+	}
+
+	ds->str[ds->count] = '\0';
+	return (struct pfasta_span){ds->str, ds->count};
+}
+
+/** @brief Returns the current length of the dynamic string. */
+static inline size_t dynstr_len(const dynstr *ds) { return ds->count; }
+
+/* Parallel parsing. A memory-mapped file is cut into chunks right before a
+ * "\n>", so that every chunk consists of complete records and can be parsed by
+ * a parser of its own. Worker threads parse the chunks into arrays of records;
+ * the consumer drains these arrays either in file order or in the order in
+ * which the chunks get done. Line numbers only matter for error messages.
+ * Thus, they are not tracked across chunks. Instead, a failing chunk is parsed
+ * a second time starting from the number of newlines before it.
+ */
+
+#define PARALLEL_CHUNK_SIZE (16 << 20)
+
+enum { CHUNK_PENDING, CHUNK_RUNNING, CHUNK_DONE, CHUNK_CONSUMED };
+
+struct pfasta_chunk {
+	const char *begin, *end;
+	int state;
+	int failed;
+	struct pfasta_record *records;
+	size_t count, capacity, next;
+};
+
+struct pfasta_parallel_state {
+	struct pfasta_parser source;
+	int flags;
+	int sequential;
+
+	pthread_mutex_t lock;
+	pthread_cond_t ready, space;
+	int synchronized;
+	int stop;
+	pthread_t *threads;
+	size_t thread_count;
+
+	struct pfasta_chunk *chunks, *active;
+	size_t chunk_count;
+	size_t next_chunk;  // next chunk to be claimed by a worker
+	size_t outstanding; // chunks claimed, but not yet consumed
+	size_t window;      // maximum number of outstanding chunks
+	size_t consumed;    // number of consumed chunks
+	size_t first_left;  // all chunks before this one are consumed
+};
+
+/** @brief Cut [begin, end) into chunks of at least `chunk_size` bytes. Each
+ * chunk, but the first, starts with a '>' at the beginning of a line.
+ *
+ * @returns 0 iff successful.
+ */
+static int parallel_split(struct pfasta_parallel_state *st, const char *begin,
+                          const char *end, size_t chunk_size) {
+	size_t max_chunks = (end - begin) / chunk_size + 1;
+	st->chunks = calloc(max_chunks, sizeof(*st->chunks));
+	if (!st->chunks) return -1;
+
+	const char *ptr = begin;
+	while (ptr < end) {
+		const char *next = end;
+		if ((size_t)(end - ptr) > chunk_size) {
+			const char *probe = ptr + chunk_size - 1;
+			const char *found = memmem(probe, end - probe, "\n>", 2);
+			if (found) next = found + 1;
+		}
+
+		st->chunks[st->chunk_count++] =
+		    (struct pfasta_chunk){.begin = ptr, .end = next};
+		ptr = next;
+	}
+
+	return 0;
+}
+
+/** @brief Parse a single chunk into its array of records. */
+static void parallel_parse(struct pfasta_chunk *chunk, int flags) {
+	struct pfasta_parser pp = parser_init_range(chunk->begin, chunk->end, 1);
+	int parser_flags = flags & (PFASTA_STRUCTURAL | TRANSFORM_FLAGS);
+	if (!pp.errstr && pfasta_set_flags(&pp, parser_flags)) {
+		chunk->failed = 1;
+	}
+
+	while (!pp.errstr && !pp.done && !chunk->failed) {
+		struct pfasta_record pr = pfasta_read(&pp);
+		if (pp.errstr) break;
+
+		if (chunk->count == chunk->capacity) {
+			size_t capacity = chunk->capacity ? chunk->capacity * 2 : 64;
+			struct pfasta_record *records =
+			    pfasta_reallocarray(chunk->records, capacity, sizeof(pr));
+			if (!records) {
+				pfasta_record_free(&pr);
+				chunk->failed = 1;
+				break;
+			}
+			chunk->records = records;
+			chunk->capacity = capacity;
+		}
+		chunk->records[chunk->count++] = pr;
+	}
+
+	if (pp.errstr) chunk->failed = 1;
+	pfasta_free(&pp);
+}
+
+static void *parallel_work(void *arg) {
+	struct pfasta_parallel_state *st = arg;
+
+	pthread_mutex_lock(&st->lock);
+	while (1) {
+		while (!st->stop && st->next_chunk < st->chunk_count &&
+		       st->outstanding >= st->window) {
+			pthread_cond_wait(&st->space, &st->lock);
+		}
+		if (st->stop || st->next_chunk >= st->chunk_count) break;
+
+		struct pfasta_chunk *chunk = &st->chunks[st->next_chunk++];
+		chunk->state = CHUNK_RUNNING;
+		st->outstanding++;
+		pthread_mutex_unlock(&st->lock);
+
+		parallel_parse(chunk, st->flags);
+
+		pthread_mutex_lock(&st->lock);
+		chunk->state = CHUNK_DONE;
+		pthread_cond_broadcast(&st->ready);
+	}
+	pthread_mutex_unlock(&st->lock);
+
+	return NULL;
+}
+
+/** @brief Wait for the next chunk to hand out. Must hold the lock. */
+static struct pfasta_chunk *parallel_next(struct pfasta_parallel_state *st) {
+	while (1) {
+		while (st->first_left < st->chunk_count &&
+		       st->chunks[st->first_left].state == CHUNK_CONSUMED) {
+			st->first_left++;
+		}
+
+		if (st->flags & PFASTA_UNORDERED) {
+			for (size_t i = st->first_left; i < st->next_chunk; i++) {
+				if (st->chunks[i].state == CHUNK_DONE) return &st->chunks[i];
+			}
+		} else if (st->chunks[st->first_left].state == CHUNK_DONE) {
+			return &st->chunks[st->first_left];
+		}
+
+		pthread_cond_wait(&st->ready, &st->lock);
+	}
+}
+
+/** @brief Hand a drained chunk back so workers can move on. */
+static void parallel_retire(struct pfasta_parallel_state *st,
+                            struct pfasta_chunk *chunk) {
+	free(chunk->records);
+	chunk->records = NULL;
+	chunk->state = CHUNK_CONSUMED;
+	st->outstanding--;
+	st->consumed++;
+	pthread_cond_broadcast(&st->space);
+}
+
+/** @brief Reproduce the error of a failed chunk with the correct line number,
+ * exactly as a sequential parser would have reported it.
+ */
+static void parallel_fail(struct pfasta_parallel *pp,
+                          const struct pfasta_chunk *chunk) {
+	const struct pfasta_parallel_state *st = pp->state;
+
+	size_t line_number = 1;
+	for (const struct pfasta_chunk *prev = st->chunks; prev < chunk; prev++) {
+		line_number += count_newlines(prev->begin, prev->end);
+	}
+
+	// Parse up to the end of the file, so that the error is not affected by
+	// the artificial end of the chunk.
+	const char *end = st->chunks[st->chunk_count - 1].end;
+	struct pfasta_parser cp = parser_init_range(chunk->begin, end, line_number);
+	if (!cp.errstr) pfasta_set_flags(&cp, st->flags & TRANSFORM_FLAGS);
+	while (!cp.errstr && !cp.done) {
+		struct pfasta_record pr = pfasta_read(&cp);
+		pfasta_record_free(&pr);
+	}
+
+	pp->errstr = cp.errstr ? cp.errstr : "Out of memory.";
+	pfasta_free(&cp);
+}
+
+struct pfasta_parallel pfasta_parallel_init(int file_descriptor, size_t threads,
+                                            size_t chunk_size, int flags) {
+	int return_code = 0;
+	struct pfasta_parallel pp = {0};
+
+	struct pfasta_parallel_state *st = calloc(1, sizeof(*st));
+	if (!st) PF_FAIL_ERRNO(&pp);
+	pp.state = st;
+	st->flags = flags;
+
+	st->source = pfasta_init(file_descriptor);
+	pp.errstr = st->source.errstr;
+	PF_FAIL_BUBBLE(&pp);
+
+	int source_flags =
+	    flags & (PFASTA_STRUCTURAL | PFASTA_READAHEAD | TRANSFORM_FLAGS);
+	if (pfasta_set_flags(&st->source, source_flags)) {
+		PF_FAIL_ERRNO(&pp);
+	}
+
+	if (threads == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? (size_t)cpus : 1;
+	}
+	if (chunk_size == 0) chunk_size = PARALLEL_CHUNK_SIZE;
+
+	// Streams cannot be split up front. Without thread-local error strings,
+	// the workers would clobber each others messages.
+	if (!PFASTA_THREADSAFE || threads < 2 ||
+	    st->source.backend != BACKEND_MMAP) {
+		st->sequential = 1;
+		goto cleanup;
+	}
+
+	if (parallel_split(st, buffer_begin(&st->source),
+	                   buffer_end(&st->source), chunk_size)) {
+		PF_FAIL_ERRNO(&pp);
+	}
+
+	if (threads > st->chunk_count) threads = st->chunk_count;
+	st->window = 2 * threads;
+	st->threads = calloc(threads, sizeof(*st->threads));
+	if (!st->threads) PF_FAIL_ERRNO(&pp);
+
+	pthread_mutex_init(&st->lock, NULL);
+	pthread_cond_init(&st->ready, NULL);
+	pthread_cond_init(&st->space, NULL);
+	st->synchronized = 1;
+
+	for (size_t i = 0; i < threads; i++) {
+		int check = pthread_create(&st->threads[i], NULL, parallel_work, st);
+		if (check) {
+			errno = check;
+			PF_FAIL_ERRNO(&pp);
+		}
+		st->thread_count++;
+	}
+
+cleanup:
+	if (return_code) {
+		pfasta_parallel_free(&pp);
+		pp.done = 1;
+	} else {
+		pp.done = st->sequential && st->source.done;
+	}
+	return pp;
+}
+
+struct pfasta_record pfasta_parallel_read(struct pfasta_parallel *pp) {
+	struct pfasta_record pr = {0};
+	struct pfasta_parallel_state *st = pp->state;
+
+	if (st->sequential) {
+		pr = pfasta_read(&st->source);
+		pp->errstr = st->source.errstr;
+		pp->done = st->source.done;
+		return pr;
+	}
+
+	pthread_mutex_lock(&st->lock);
+	while (st->consumed < st->chunk_count) {
+		struct pfasta_chunk *chunk = st->active;
+		if (!chunk) chunk = st->active = parallel_next(st);
+
+		if (chunk->next < chunk->count) {
+			pr = chunk->records[chunk->next++];
+			if (chunk->next == chunk->count && !chunk->failed) {
+				parallel_retire(st, chunk);
+				st->active = NULL;
+			}
+			break;
+		}
+
+		if (chunk->failed) {
+			pthread_mutex_unlock(&st->lock);
+			parallel_fail(pp, chunk);
+			pp->done = 1;
+			return pr;
+		}
+
+		parallel_retire(st, chunk);
+		st->active = NULL;
+	}
+	pp->done = st->consumed == st->chunk_count;
+	pthread_mutex_unlock(&st->lock);
+
+	return pr;
+}
+
+void pfasta_parallel_free(struct pfasta_parallel *pp) {
+	if (!pp || !pp->state) return;
+	struct pfasta_parallel_state *st = pp->state;
+
+	if (st->synchronized) {
+		pthread_mutex_lock(&st->lock);
+		st->stop = 1;
+		pthread_cond_broadcast(&st->space);
+		pthread_mutex_unlock(&st->lock);
+
+		for (size_t i = 0; i < st->thread_count; i++) {
+			pthread_join(st->threads[i], NULL);
+		}
+
+		pthread_cond_destroy(&st->space);
+		pthread_cond_destroy(&st->ready);
+		pthread_mutex_destroy(&st->lock);
+	}
+
+	for (size_t i = 0; i < st->chunk_count; i++) {
+		struct pfasta_chunk *chunk = &st->chunks[i];
+		for (size_t j = chunk->next; j < chunk->count; j++) {
+			pfasta_record_free(&chunk->records[j]);
+		}
+		free(chunk->records);
+	}
+
+	free(st->chunks);
+	free(st->threads);
+	pfasta_free(&st->source);
+	free(st);
+	pp->state = NULL;
+}
+
+/* Indexing. A .fai index, as written by `samtools faidx`, stores for every
+ * record its name, the number of bases, the offset of the first base and the
+ * line geometry: the number of bases per line and the number of bytes per line
+ * including the line terminator. With that, the position of any base can be
+ * computed directly. This only works if all lines of a record have the same
+ * length, except for the last one.
+ */
+
+/** @brief The state of the indexer between two lines. */
+struct index_state {
+	struct pfasta_index_entry entry; // the record being scanned
+	int has_entry;
+	int short_line; // a short line must be the last one of a record
+	size_t line_number;
+	char *name; // the name of the next record, while it is being read
+	size_t name_length, name_capacity;
+	int name_done;
+};
+
+/** @brief Append a finished entry to the index. */
+static int index_push(struct pfasta_index *index,
+                      struct pfasta_index_entry entry) {
+	int return_code = 0;
+
+	if (index->count == index->capacity) {
+		size_t capacity = index->capacity ? index->capacity / 2 * 3 : 16;
+		struct pfasta_index_entry *entries =
+		    pfasta_reallocarray(index->entries, capacity, sizeof(*entries));
+		if (!entries) PF_FAIL_ERRNO(index);
+		index->entries = entries;
+		index->capacity = capacity;
+	}
+
+	index->entries[index->count++] = entry;
+
+cleanup:
+	return return_code;
+}
+
+/** @brief Collect the name from a piece of a header line. */
+static int index_name(struct pfasta_index *index, struct index_state *is,
+                      const char *begin, const char *end) {
+	int return_code = 0;
+	if (is->name_done) goto cleanup;
+
+	const char *ptr = begin;
+	while (ptr < end && !my_isspace(*ptr)) {
+		ptr++;
+	}
+	if (ptr < end) is->name_done = 1;
+
+	size_t length = ptr - begin;
+	if (is->name_length + length + 1 > is->name_capacity) {
+		size_t capacity = (is->name_length + length + 1) * 2;
+		char *name = realloc(is->name, capacity);
+		if (!name) PF_FAIL_ERRNO(index);
+		is->name = name;
+		is->name_capacity = capacity;
+	}
+
+	memcpy(is->name + is->name_length, begin, length);
+	is->name_length += length;
+	is->name[is->name_length] = '\0';
+
+cleanup:
+	return return_code;
+}
+
+/** @brief Account for a complete line.
+ *
+ * @param begin - The offset of the first byte of the line.
+ * @param length - The number of bytes, excluding the newline.
+ * @param has_newline - Set iff the line is terminated by a newline.
+ * @param first - The first byte of the line.
+ * @param last - The last byte of the line before the newline.
+ */
+static int index_line(struct pfasta_index *index, struct index_state *is,
+                      size_t begin, size_t length, int has_newline, int first,
+                      int last) {
+	int return_code = 0;
+	int check;
+
+	if (first == '>') {
+		if (is->name_length == 0)
+			PF_FAIL_STR(index, "Empty name on line %zu.", is->line_number);
+
+		if (is->has_entry) {
+			check = index_push(index, is->entry);
+			PF_FAIL_BUBBLE_CHECK(index, check);
+		}
+
+		is->entry = (struct pfasta_index_entry){0};
+		is->entry.name = is->name;
+		is->entry.offset = begin + length + has_newline;
+		is->has_entry = 1;
+		is->short_line = 0;
+
+		is->name = NULL;
+		is->name_length = is->name_capacity = 0;
+		is->name_done = 0;
+		goto cleanup;
+	}
+
+	if (!is->has_entry) PF_FAIL_STR_CONST(index, "File must start with '>'.");
+
+	size_t bases = length - (last == '\r');
+	size_t bytes = length + 1;
+	struct pfasta_index_entry *entry = &is->entry;
+
+	if (bases == 0) {
+		// Blank lines may only trail a record.
+		is->short_line = 1;
+		goto cleanup;
+	}
+
+	if (entry->line_bases == 0) {
+		entry->line_bases = bases;
+		entry->line_bytes = bytes;
+	} else if (is->short_line || bases > entry->line_bases ||
+	           (has_newline &&
+	            bytes - bases != entry->line_bytes - entry->line_bases)) {
+		PF_FAIL_STR(index, "Unequal line lengths in record on line %zu.",
+		            is->line_number);
+	} else if (bases < entry->line_bases) {
+		is->short_line = 1;
+	}
+
+	entry->length += bases;
+
+cleanup:
+	return return_code;
+}
+
+/** @brief Find the slot holding `name`, or the empty one where it belongs. */
+static size_t index_slot(const struct pfasta_index *index, const char *name) {
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (const char *ptr = name; *ptr; ptr++) {
+		hash ^= (unsigned char)*ptr;
+		hash *= 1099511628211ULL;
+	}
+
+	size_t mask = index->slot_count - 1;
+	size_t slot = hash & mask;
+	while (index->slots[slot] &&
+	       strcmp(index->entries[index->slots[slot] - 1].name, name) != 0) {
+		slot = (slot + 1) & mask;
+	}
+
+	return slot;
+}
+
+/** @brief Make the entries searchable by name. Duplicate names resolve to the
+ * first entry.
+ */
+static int index_hash(struct pfasta_index *index) {
+	int return_code = 0;
+
+	size_t slot_count = 16;
+	while (slot_count < 2 * index->count) {
+		slot_count *= 2;
+	}
+
+	free(index->slots);
+	index->slots = calloc(slot_count, sizeof(*index->slots));
+	if (!index->slots) PF_FAIL_ERRNO(index);
+	index->slot_count = slot_count;
+
+	for (size_t i = 0; i < index->count; i++) {
+		size_t slot = index_slot(index, index->entries[i].name);
+		if (!index->slots[slot]) index->slots[slot] = i + 1;
+	}
+
+cleanup:
+	return return_code;
+}
+
+struct pfasta_index pfasta_index_build(int file_descriptor) {
+	int return_code = 0;
+	int check;
+	struct pfasta_index index = {0};
+	index.file_descriptor = file_descriptor;
+
+	struct index_state is = {0};
+	is.line_number = 1;
+
+	// Let the parser's input layer map, read or decompress the file.
+	struct pfasta_parser pp = pfasta_init(file_descriptor);
+	if (pp.errstr) {
+		index.errstr = pp.errstr;
+		return_code = E_BUBBLE;
+		goto cleanup;
+	}
+
+	if (pp.backend == BACKEND_GZIP) {
+		if (!pp.inflate->bgzf) {
+			PF_FAIL_STR_CONST(&index,
+			                  "Random access requires BGZF compression.");
+		}
+		if (bgzf_record_start(pp.inflate)) PF_FAIL_ERRNO(&index);
+		index.compressed = 1;
+	}
+
+	// The current line: where it started, how long it is so far, and its
+	// first and last byte.
+	size_t line_begin = 0, line_length = 0;
+	int first = EOF, last = EOF;
+
+	while (1) {
+		const char *ptr = buffer_begin(&pp);
+		const char *end = buffer_end(&pp);
+		while (ptr < end) {
+			const char *newline = memchr(ptr, '\n', end - ptr);
+			const char *stop = newline ? newline : end;
+
+			if (stop > ptr) {
+				const char *text = ptr;
+				if (first == EOF) {
+					first = *(const unsigned char *)text;
+					if (first == '>') text++;
+				}
+				if (first == '>') {
+					check = index_name(&index, &is, text, stop);
+					PF_FAIL_BUBBLE_CHECK(&index, check);
+				}
+				last = *(const unsigned char *)(stop - 1);
+				line_length += stop - ptr;
+			}
+
+			if (!newline) break;
+
+			check = index_line(&index, &is, line_begin, line_length, 1, first,
+			                   last);
+			PF_FAIL_BUBBLE_CHECK(&index, check);
+
+			is.line_number++;
+			line_begin += line_length + 1;
+			line_length = 0;
+			first = last = EOF;
+			ptr = newline + 1;
+		}
+
+		check = buffer_read(&pp);
+		if (check == E_EOF) break;
+		if (check) {
+			index.errstr = pp.errstr;
+			return_code = E_BUBBLE;
+			goto cleanup;
+		}
+	}
+
+	if (index.compressed) {
+		// Keep the block offsets for fetching.
+		index.blocks = pp.inflate->blocks;
+		index.block_count = pp.inflate->block_count;
+		pp.inflate->blocks = NULL;
+	}
+
+	if (line_length) {
+		check = index_line(&index, &is, line_begin, line_length, 0, first,
+		                   last);
+		PF_FAIL_BUBBLE_CHECK(&index, check);
+	}
+
+	if (!is.has_entry) PF_FAIL_STR_CONST(&index, "File is empty.");
+
+	check = index_push(&index, is.entry);
+	PF_FAIL_BUBBLE_CHECK(&index, check);
+	is.has_entry = 0;
+
+	check = index_hash(&index);
+	PF_FAIL_BUBBLE_CHECK(&index, check);
+
+cleanup:
+	pfasta_free(&pp);
+	free(is.name);
+	if (is.has_entry) free(is.entry.name);
+	if (return_code) {
+		pfasta_index_free(&index);
+	}
+	return index;
+}
+
+/** @brief Parse a number from a field of a .fai file. */
+static int index_number(const char **ptr, size_t *number, int separator) {
+	const char *str = *ptr;
+	if (*str < '0' || *str > '9') return -1;
+
+	size_t value = 0;
+	for (; *str >= '0' && *str <= '9'; str++) {
+		size_t digit = *str - '0';
+		if (value > (SIZE_MAX - digit) / 10) return -1;
+		value = value * 10 + digit;
+	}
+
+	if (*str != separator) return -1;
+
+	*number = value;
+	*ptr = str + 1;
+	return 0;
+}
+
+struct pfasta_index pfasta_index_load(int file_descriptor,
+                                      int index_descriptor) {
+	int return_code = 0;
+	int check;
+	struct pfasta_index index = {0};
+	index.file_descriptor = file_descriptor;
+
+	// Slurp the whole index; it is small compared to the file it describes.
+	char *text = NULL;
+	size_t length = 0, capacity = 0;
+	while (1) {
+		if (capacity - length < BUFFER_SIZE + 1) {
+			capacity = capacity * 2 + BUFFER_SIZE + 1;
+			char *larger = realloc(text, capacity);
+			if (!larger) PF_FAIL_ERRNO(&index);
+			text = larger;
+		}
+
+		ssize_t count =
+		    read(index_descriptor, text + length, capacity - length - 1);
+		if (count < 0 && errno == EINTR) continue;
+		if (count < 0) PF_FAIL_ERRNO(&index);
+		if (count == 0) break;
+		length += count;
+	}
+	text[length] = '\0';
+
+	size_t line_number = 1;
+	const char *ptr = text;
+	const char *end = text + length;
+	while (ptr < end) {
+		const char *tab = memchr(ptr, '\t', end - ptr);
+		const char *newline = memchr(ptr, '\n', end - ptr);
+		if (!tab || tab == ptr || (newline && newline < tab)) {
+			PF_FAIL_STR(&index, "Malformed index on line %zu.", line_number);
+		}
+
+		struct pfasta_index_entry entry = {0};
+		const char *numbers = tab + 1;
+		if (index_number(&numbers, &entry.length, '\t') ||
+		    index_number(&numbers, &entry.offset, '\t') ||
+		    index_number(&numbers, &entry.line_bases, '\t') ||
+		    index_number(&numbers, &entry.line_bytes, newline ? '\n' : '\0') ||
+		    entry.line_bytes < entry.line_bases ||
+		    (entry.length && !entry.line_bases)) {
+			PF_FAIL_STR(&index, "Malformed index on line %zu.", line_number);
+		}
+
+		entry.name = strndup(ptr, tab - ptr);
+		if (!entry.name) PF_FAIL_ERRNO(&index);
+
+		check = index_push(&index, entry);
+		if (check) free(entry.name);
+		PF_FAIL_BUBBLE_CHECK(&index, check);
+
+		line_number++;
+		ptr = newline ? newline + 1 : end;
+	}
+
+	if (index.count == 0) PF_FAIL_STR_CONST(&index, "Index is empty.");
+
+	check = index_hash(&index);
+	PF_FAIL_BUBBLE_CHECK(&index, check);
+
+	// Offsets into a compressed file need the blocks from a .gzi file, too.
+	unsigned char header[BGZF_HEADER_SIZE];
+	ssize_t count = pread(file_descriptor, header, sizeof(header), 0);
+	if (count >= 2 && header[0] == 0x1f && header[1] == 0x8b) {
+		if (count != sizeof(header) || !(header[3] & 4) || header[12] != 'B' ||
+		    header[13] != 'C') {
+			PF_FAIL_STR_CONST(&index,
+			                  "Random access requires BGZF compression.");
+		}
+		index.compressed = 1;
+	}
+
+cleanup:
+	free(text);
+	if (return_code) {
+		pfasta_index_free(&index);
+	}
+	return index;
+}
+
+int pfasta_index_write(struct pfasta_index *index, int index_descriptor) {
+	int return_code = 0;
+
+	for (size_t i = 0; i < index->count; i++) {
+		const struct pfasta_index_entry *entry = &index->entries[i];
+		int check = dprintf(index_descriptor, "%s\t%zu\t%zu\t%zu\t%zu\n",
+		                    entry->name, entry->length, entry->offset,
+		                    entry->line_bases, entry->line_bytes);
+		if (check < 0) PF_FAIL_ERRNO(index);
+	}
+
+	index->errstr = NULL;
+
+cleanup:
+	return return_code;
+}
+
+/* A .gzi file lists where the BGZF blocks start, both in the compressed file
+ * and in the decompressed data, as little-endian 64-bit numbers: first the
+ * number of blocks, then one pair of offsets per block. The first block, which
+ * always starts at zero, is left out.
+ */
+
+/** @brief Decode a little-endian 64-bit number. */
+static uint64_t gzi_decode(const unsigned char *ptr) {
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; i--) {
+		value = value << 8 | ptr[i];
+	}
+	return value;
+}
+
+/** @brief Encode a little-endian 64-bit number. */
+static unsigned char *gzi_encode(unsigned char *ptr, uint64_t value) {
+	for (int i = 0; i < 8; i++) {
+		*ptr++ = value & 0xff;
+		value >>= 8;
+	}
+	return ptr;
+}
+
+int pfasta_index_load_gzi(struct pfasta_index *index, int gzi_descriptor) {
+	int return_code = 0;
+
+	unsigned char *data = NULL;
+	size_t length = 0, capacity = 0;
+	while (1) {
+		if (capacity == length) {
+			capacity = capacity * 2 + BUFFER_SIZE;
+			unsigned char *larger = realloc(data, capacity);
+			if (!larger) PF_FAIL_ERRNO(index);
+			data = larger;
+		}
+
+		ssize_t count = read(gzi_descriptor, data + length, capacity - length);
+		if (count < 0 && errno == EINTR) continue;
+		if (count < 0) PF_FAIL_ERRNO(index);
+		if (count == 0) break;
+		length += count;
+	}
+
+	uint64_t count = length >= 8 ? gzi_decode(data) : UINT64_MAX;
+	if (count > (length - 8) / 16 || length != 8 + count * 16) {
+		PF_FAIL_STR_CONST(index, "Malformed .gzi index.");
+	}
+
+	struct pfasta_bgzf_block *blocks =
+	    pfasta_reallocarray(NULL, count + 1, sizeof(*blocks));
+	if (!blocks) PF_FAIL_ERRNO(index);
+
+	blocks[0] = (struct pfasta_bgzf_block){0};
+	for (size_t i = 1; i <= count; i++) {
+		const unsigned char *pair = data + 8 + (i - 1) * 16;
+		blocks[i].compressed = gzi_decode(pair);
+		blocks[i].uncompressed = gzi_decode(pair + 8);
+		if (blocks[i].compressed <= blocks[i - 1].compressed ||
+		    blocks[i].uncompressed < blocks[i - 1].uncompressed) {
+			free(blocks);
+			PF_FAIL_STR_CONST(index, "Malformed .gzi index.");
+		}
+	}
+
+	free(index->blocks);
+	index->blocks = blocks;
+	index->block_count = count + 1;
+	index->errstr = NULL;
+
+cleanup:
+	free(data);
+	return return_code;
+}
+
+int pfasta_index_write_gzi(struct pfasta_index *index, int gzi_descriptor) {
+	int return_code = 0;
+	unsigned char *data = NULL;
+
+	if (!index->compressed || !index->block_count) {
+		PF_FAIL_STR_CONST(index, "File is not BGZF-compressed.");
+	}
+
+	size_t length = 8 + (index->block_count - 1) * 16;
+	data = malloc(length);
+	if (!data) PF_FAIL_ERRNO(index);
+
+	unsigned char *ptr = gzi_encode(data, index->block_count - 1);
+	for (size_t i = 1; i < index->block_count; i++) {
+		ptr = gzi_encode(ptr, index->blocks[i].compressed);
+		ptr = gzi_encode(ptr, index->blocks[i].uncompressed);
+	}
+
+	size_t done = 0;
+	while (done < length) {
+		ssize_t count = write(gzi_descriptor, data + done, length - done);
+		if (count < 0 && errno == EINTR) continue;
+		if (count < 0) PF_FAIL_ERRNO(index);
+		done += count;
+	}
+
+	index->errstr = NULL;
+
+cleanup:
+	free(data);
+	return return_code;
+}
+
+#ifdef WITH_ZLIB
+
+/** @brief Read `length` bytes of decompressed data, starting at `offset`, from
+ * a BGZF-compressed file. Only the blocks covering the range are inflated.
+ */
+static int bgzf_pread(struct pfasta_index *index, char *dest, size_t length,
+                      size_t offset) {
+	int return_code = 0;
+	z_stream zs = {0};
+	int initialized = 0;
+
+	if (!index->block_count) {
+		PF_FAIL_STR_CONST(index, "Missing .gzi index.");
+	}
+
+	if (!index->scratch) {
+		index->scratch = malloc(2 * INFLATE_BLOCK_SIZE);
+		if (!index->scratch) PF_FAIL_ERRNO(index);
+	}
+	unsigned char *block = index->scratch;
+	unsigned char *data = index->scratch + INFLATE_BLOCK_SIZE;
+
+	// Find the last block starting at or before the offset.
+	size_t low = 0, high = index->block_count;
+	while (high - low > 1) {
+		size_t mid = low + (high - low) / 2;
+		if (index->blocks[mid].uncompressed <= offset) {
+			low = mid;
+		} else {
+			high = mid;
+		}
+	}
+
+	if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+		PF_FAIL_STR_CONST(index, "Out of memory.");
+	}
+	initialized = 1;
+
+	size_t position = index->blocks[low].compressed;
+	size_t skip = offset - index->blocks[low].uncompressed;
+	while (length) {
+		size_t block_size = BGZF_HEADER_SIZE;
+		size_t done = 0;
+		while (done < block_size) {
+			ssize_t count = pread(index->file_descriptor, block + done,
+			                      block_size - done, position + done);
+			if (count < 0 && errno == EINTR) continue;
+			if (count < 0) PF_FAIL_ERRNO(index);
+			if (count == 0) {
+				PF_FAIL_STR_CONST(index, "Index exceeds the file.");
+			}
+			done += count;
+
+			if (done == BGZF_HEADER_SIZE && block_size == BGZF_HEADER_SIZE) {
+				block_size = bgzf_block_size(block);
+				if (!block_size) {
+					PF_FAIL_STR_CONST(index, "Malformed BGZF block.");
+				}
+			}
+		}
+
+		ssize_t count = bgzf_inflate(&zs, block, block_size, data);
+		if (count < 0) PF_FAIL_STR_CONST(index, "Corrupt compressed data.");
+
+		size_t available = (size_t)count > skip ? count - skip : 0;
+		size_t chunk = available < length ? available : length;
+		memcpy(dest, data + skip, chunk);
+		dest += chunk;
+		length -= chunk;
+		skip -= (size_t)count < skip ? (size_t)count : skip;
+
+		position += block_size;
+	}
+
+cleanup:
+	if (initialized) inflateEnd(&zs);
+	return return_code;
+}
+
+#else
+
+static int bgzf_pread(struct pfasta_index *index, char *dest, size_t length,
+                      size_t offset) {
+	(void)dest;
+	(void)length;
+	(void)offset;
+
+	int return_code = 0;
+	PF_FAIL_STR_CONST(index, "Compressed input requires zlib support.");
+
+cleanup:
+	return return_code;
+}
+
+#endif
+
+char *pfasta_fetch(struct pfasta_index *index, const char *name, size_t start,
+                   size_t end) {
+	int return_code = 0;
+	char *result = NULL;
+
+	size_t slot = index_slot(index, name);
+	if (!index->slots[slot]) PF_FAIL_STR(index, "Unknown sequence: %s", name);
+	const struct pfasta_index_entry *entry =
+	    &index->entries[index->slots[slot] - 1];
+
+	if (end > entry->length) end = entry->length;
+	if (start > end) start = end;
+	size_t length = end - start;
+
+	if (length == 0) {
+		result = malloc(1);
+		if (!result) PF_FAIL_ERRNO(index);
+		result[0] = '\0';
+		goto cleanup;
+	}
+
+	// Translate base positions to file offsets using the line geometry.
+	size_t line_bases = entry->line_bases;
+	size_t line_bytes = entry->line_bytes;
+	size_t first = entry->offset + start / line_bases * line_bytes +
+	               start % line_bases;
+	size_t last = entry->offset + (end - 1) / line_bases * line_bytes +
+	              (end - 1) % line_bases;
+	size_t bytes = last - first + 1;
+
+	result = malloc(bytes + 1);
+	if (!result) PF_FAIL_ERRNO(index);
+
+	if (index->compressed) {
+		int check = bgzf_pread(index, result, bytes, first);
+		PF_FAIL_BUBBLE_CHECK(index, check);
+	}
+
+	size_t done = index->compressed ? bytes : 0;
+	while (done < bytes) {
+		ssize_t count = pread(index->file_descriptor, result + done,
+		                      bytes - done, first + done);
+		if (count < 0 && errno == EINTR) continue;
+		if (count < 0) PF_FAIL_ERRNO(index);
+		if (count == 0) PF_FAIL_STR_CONST(index, "Index exceeds the file.");
+		done += count;
+	}
+
+	// Squeeze out the line terminators in place.
+	char *out = result;
+	const char *in = result;
+	size_t column = start % line_bases;
+	size_t remaining = length;
+	while (remaining) {
+		size_t chunk = line_bases - column;
+		if (chunk > remaining) chunk = remaining;
+		memmove(out, in, chunk);
+		out += chunk;
+		in += chunk + line_bytes - line_bases;
+		remaining -= chunk;
+		column = 0;
+	}
+	*out = '\0';
+
+	index->errstr = NULL;
+
+cleanup:
+	if (return_code) {
+		free(result);
+		result = NULL;
+	}
+	return result;
+}
+
+void pfasta_index_free(struct pfasta_index *index) {
+	if (!index) return;
+	for (size_t i = 0; i < index->count; i++) {
+		free(index->entries[i].name);
+	}
+	free(index->entries);
+	free(index->slots);
+	free(index->blocks);
+	free(index->scratch);
+	index->entries = NULL;
+	index->slots = NULL;
+	index->blocks = NULL;
+	index->scratch = NULL;
+	index->count = index->capacity = index->slot_count = 0;
+	index->block_count = 0;
+}
+
+/* Queues of files. With many small files, opening, reading and closing them
+ * one after the other costs more than the parsing. A queue therefore opens the
+ * upcoming files and reads their first blocks via io_uring while the current
+ * file is parsed. The parsers it hands out keep two buffers per file, one being
+ * parsed and one being filled, and consume the completions of reads submitted
+ * ahead of them. Without io_uring, the files are simply opened in turn.
+ */
+
+#define URING_DEPTH 16
+#define URING_BUFFER_SIZE (128 << 10)
+
+enum { URING_OPEN, URING_READ, URING_CLOSE };
+enum { FILE_IDLE, FILE_OPENING, FILE_READY, FILE_ATTACHED };
+enum { BUFFER_EMPTY, BUFFER_BUSY, BUFFER_FILLED };
+
+struct uring_buffer {
+	int state;
+	ssize_t length; // or the negated errno of a failed read
+	char *data;
+};
+
+struct pfasta_uring_slot {
+	struct pfasta_queue_state *queue;
+	int state;
+	size_t file; // index into the file names
+	int file_descriptor;
+	int error; // of the open
+	int eof;
+	int whole; // the file fits into the first buffer
+	struct uring_buffer buffers[2];
+	size_t current; // the buffer the parser is walking
+};
+
+struct pfasta_queue_state {
+	char *const *file_names;
+	size_t count;
+	size_t next_open; // next file to be opened ahead
+	size_t next_file; // next file to hand out
+
+	struct uring_ring *ring; // NULL without io_uring
+	struct pfasta_uring_slot slots[URING_DEPTH];
+};
+
+#if PF_URING
+
+struct uring_ring {
+	int file_descriptor;
+	void *mapping;
+	size_t mapped_length;
+	struct io_uring_sqe *sqes;
+	size_t sqes_length;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned to_submit; // queued, but not yet passed to the kernel
+	size_t in_flight;   // submitted or queued, but not yet completed
+};
+
+static void uring_free(struct uring_ring *ring) {
+	if (!ring) return;
+	if (ring->sqes) munmap(ring->sqes, ring->sqes_length);
+	if (ring->mapping) munmap(ring->mapping, ring->mapped_length);
+	close(ring->file_descriptor);
+	free(ring);
+}
+
+/** @brief Returns 1 iff the kernel supports all operations a queue needs. */
+static int uring_probe(int ring_descriptor) {
+	const size_t ops = 256;
+	struct io_uring_probe *probe =
+	    calloc(1, sizeof(*probe) + ops * sizeof(struct io_uring_probe_op));
+	if (!probe) return 0;
+
+	int supported = 0;
+	if (syscall(__NR_io_uring_register, ring_descriptor, IORING_REGISTER_PROBE,
+	            probe, ops) == 0) {
+		supported = 1;
+		const int needed[] = {IORING_OP_OPENAT, IORING_OP_READ,
+		                      IORING_OP_CLOSE};
+		for (size_t i = 0; i < sizeof(needed) / sizeof(needed[0]); i++) {
+			if (needed[i] > probe->last_op ||
+			    !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) {
+				supported = 0;
+			}
+		}
+	}
+
+	free(probe);
+	return supported;
+}
+
+/** @brief Set up a ring using the raw system calls.
+ *
+ * @returns NULL if io_uring is unavailable, e.g. on older kernels or inside
+ * sandboxes that block it.
+ */
+static struct uring_ring *uring_setup(unsigned entries) {
+	struct io_uring_params params = {0};
+	int ring_descriptor = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring_descriptor < 0) return NULL;
+
+	struct uring_ring *ring = calloc(1, sizeof(*ring));
+	if (!ring) {
+		close(ring_descriptor);
+		return NULL;
+	}
+	ring->file_descriptor = ring_descriptor;
+
+	// Reads at the current file position and a shared mapping of both rings
+	// came with the same kernels as the operations that are probed.
+	const unsigned features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_RW_CUR_POS;
+	if ((params.features & features) != features ||
+	    !uring_probe(ring_descriptor)) {
+		goto fail;
+	}
+
+	size_t sq_length = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	size_t cq_length =
+	    params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->mapped_length = sq_length > cq_length ? sq_length : cq_length;
+
+	void *mapping = mmap(NULL, ring->mapped_length, PROT_READ | PROT_WRITE,
+	                     MAP_SHARED | MAP_POPULATE, ring_descriptor,
+	                     IORING_OFF_SQ_RING);
+	if (mapping == MAP_FAILED) goto fail;
+	ring->mapping = mapping;
+
+	ring->sqes_length = params.sq_entries * sizeof(struct io_uring_sqe);
+	void *sqes = mmap(NULL, ring->sqes_length, PROT_READ | PROT_WRITE,
+	                  MAP_SHARED | MAP_POPULATE, ring_descriptor,
+	                  IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) goto fail;
+	ring->sqes = sqes;
+
+	char *base = mapping;
+	ring->sq_head = (unsigned *)(base + params.sq_off.head);
+	ring->sq_tail = (unsigned *)(base + params.sq_off.tail);
+	ring->sq_mask = (unsigned *)(base + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(base + params.sq_off.array);
+	ring->cq_head = (unsigned *)(base + params.cq_off.head);
+	ring->cq_tail = (unsigned *)(base + params.cq_off.tail);
+	ring->cq_mask = (unsigned *)(base + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+	return ring;
+
+fail:
+	uring_free(ring);
+	return NULL;
+}
+
+/** @brief Queue an operation. `user_data` encodes the slot, operation and
+ * buffer, so that the completion can be matched up.
+ */
+static void uring_push(struct uring_ring *ring, int opcode, int fd,
+                       const void *addr, unsigned length, uint64_t user_data) {
+	unsigned tail = *ring->sq_tail;
+	unsigned index = tail & *ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)addr;
+	sqe->len = length;
+	sqe->user_data = user_data;
+	if (opcode == IORING_OP_OPENAT) sqe->open_flags = O_RDONLY | O_CLOEXEC;
+	if (opcode == IORING_OP_READ) sqe->off = (uint64_t)-1; // current position
+
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->to_submit++;
+	ring->in_flight++;
+}
+
+static uint64_t uring_tag(const struct pfasta_queue_state *st,
+                          const struct pfasta_uring_slot *slot, int op,
+                          size_t buffer) {
+	return (uint64_t)(slot - st->slots) << 3 | (uint64_t)op << 1 | buffer;
+}
+
+static void uring_read(struct pfasta_queue_state *st,
+                       struct pfasta_uring_slot *slot, size_t buffer) {
+	slot->buffers[buffer].state = BUFFER_BUSY;
+	uring_push(st->ring, IORING_OP_READ, slot->file_descriptor,
+	           slot->buffers[buffer].data, URING_BUFFER_SIZE,
+	           uring_tag(st, slot, URING_READ, buffer));
+}
+
+/** @brief Open the upcoming files in all idle slots. */
+static void uring_fill(struct pfasta_queue_state *st) {
+	for (size_t i = 0; i < URING_DEPTH && st->next_open < st->count; i++) {
+		struct pfasta_uring_slot *slot = &st->slots[i];
+		if (slot->state != FILE_IDLE) continue;
+
+		// Standard input is never opened ahead.
+		while (st->next_open < st->count &&
+		       strcmp(st->file_names[st->next_open], "-") == 0) {
+			st->next_open++;
+		}
+		if (st->next_open == st->count) break;
+
+		slot->state = FILE_OPENING;
+		slot->file = st->next_open++;
+		slot->error = slot->eof = slot->whole = 0;
+		slot->current = 0;
+		uring_push(st->ring, IORING_OP_OPENAT, AT_FDCWD,
+		           st->file_names[slot->file], 0,
+		           uring_tag(st, slot, URING_OPEN, 0));
+	}
+}
+
+/** @brief Submit the queued operations and handle at least one completion.
+ *
+ * @returns 0 iff successful; otherwise errno is set.
+ */
+static int uring_wait(struct pfasta_queue_state *st) {
+	struct uring_ring *ring = st->ring;
+
+	int count = syscall(__NR_io_uring_enter, ring->file_descriptor,
+	                    ring->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+	if (count < 0) return errno == EINTR ? 0 : -1;
+	ring->to_submit -= count;
+
+	unsigned head = *ring->cq_head;
+	unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+		struct pfasta_uring_slot *slot = &st->slots[cqe->user_data >> 3];
+		int op = (cqe->user_data >> 1) & 3;
+		size_t buffer = cqe->user_data & 1;
+		ring->in_flight--;
+
+		if (op == URING_OPEN && cqe->res < 0) {
+			slot->error = -cqe->res;
+			slot->state = FILE_READY;
+		} else if (op == URING_OPEN) {
+			slot->file_descriptor = cqe->res;
+			uring_read(st, slot, 0);
+		} else if (op == URING_READ) {
+			slot->buffers[buffer].length = cqe->res;
+			slot->buffers[buffer].state = BUFFER_FILLED;
+			if (cqe->res <= 0) slot->eof = 1;
+			if (slot->state == FILE_OPENING) {
+				// Also read ahead the second block, or find the end.
+				slot->state = FILE_READY;
+				if (cqe->res > 0) uring_read(st, slot, 1);
+			}
+		}
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/** @brief Wait until no read into the slot's buffers is pending. */
+static int uring_settle(struct pfasta_uring_slot *slot) {
+	while (slot->buffers[0].state == BUFFER_BUSY ||
+	       slot->buffers[1].state == BUFFER_BUSY) {
+		if (uring_wait(slot->queue)) return -1;
+	}
+	return 0;
+}
+
+/** @brief Hand the next filled buffer of the file to the parser.
+ *
+ * @returns the number of bytes in the buffer, 0 at the end of the file, or -1
+ * with errno set on error.
+ */
+static ssize_t uring_next(struct pfasta_parser *pp) {
+	struct pfasta_uring_slot *slot = pp->uring;
+	struct pfasta_queue_state *st = slot->queue;
+	struct uring_buffer *done = &slot->buffers[slot->current];
+	struct uring_buffer *next = &slot->buffers[!slot->current];
+
+	if (done->state == BUFFER_FILLED && done->length <= 0) {
+		// Stay at the end of the file.
+		if (done->length < 0) errno = -done->length;
+		return done->length < 0 ? -1 : 0;
+	}
+	done->state = BUFFER_EMPTY;
+
+	if (next->state == BUFFER_EMPTY && !slot->eof) {
+		uring_read(st, slot, !slot->current);
+	}
+	while (next->state == BUFFER_BUSY) {
+		if (uring_wait(st)) return -1;
+	}
+
+	slot->current = !slot->current;
+	ssize_t count = next->state == BUFFER_FILLED ? next->length : 0;
+	if (count <= 0) {
+		next->state = BUFFER_FILLED;
+		next->length = count;
+		if (count < 0) errno = -count;
+		return count < 0 ? -1 : 0;
+	}
+
+	pp->buffer = next->data;
+
+	// Keep a read in flight while the parser works on this buffer.
+	if (!slot->eof) uring_read(st, slot, !slot->current);
+	return count;
+}
+
+static int uring_is_whole(const struct pfasta_uring_slot *slot) {
+	return slot->whole;
+}
+
+/** @brief Return a slot to the queue after its parser is done. */
+static void uring_release(struct pfasta_uring_slot *slot) {
+	struct pfasta_queue_state *st = slot->queue;
+
+	// A pending read must not land in a buffer of the next file.
+	(void)uring_settle(slot);
+	if (slot->state != FILE_IDLE && !slot->error) {
+		uring_push(st->ring, IORING_OP_CLOSE, slot->file_descriptor, NULL, 0,
+		           uring_tag(st, slot, URING_CLOSE, 0));
+	}
+
+	slot->state = FILE_IDLE;
+	slot->buffers[0].state = slot->buffers[1].state = BUFFER_EMPTY;
+	uring_fill(st);
+}
+
+/** @brief Turn the slot holding the next file into a parser. */
+static struct pfasta_parser uring_attach(struct pfasta_uring_slot *slot) {
+	int return_code = 0;
+	struct pfasta_parser pp = {0};
+	pp.line_number = 1;
+	pp.file_descriptor = -1;
+
+	kernels_select();
+
+	pp.started = stats_clock();
+	while (slot->state == FILE_OPENING) {
+		if (uring_wait(slot->queue)) PF_FAIL_ERRNO(&pp);
+	}
+	pp.stats.io_nanoseconds = stats_clock() - pp.started;
+
+	if (slot->error) {
+		errno = slot->error;
+		PF_FAIL_ERRNO(&pp);
+	}
+
+	pp.backend = BACKEND_URING;
+	pp.uring = slot;
+	pp.file_descriptor = slot->file_descriptor;
+	slot->state = FILE_ATTACHED;
 
-		// optimize for more common case
-		ptrdiff_t length = buffer_end(pp) - buffer_begin(pp);
-		if (LIKELY(length >= 2 && buffer_begin(pp)[0] == '\n' &&
-		           buffer_begin(pp)[1] > ' ')) {
-			pp->read_ptr++; // nasty hack
-			pp->line_number += 1;
+	struct uring_buffer *first = &slot->buffers[0];
+	if (first->length < 0) {
+		errno = -first->length;
+		PF_FAIL_ERRNO(&pp);
+	}
+	pp.buffer = pp.read_ptr = first->data;
+	pp.fill_ptr = first->data + first->length;
+	pp.stats.reads = 1;
+	pp.stats.bytes_read = first->length;
+	if (!slot->eof && slot->buffers[1].state == BUFFER_EMPTY) {
+		uring_read(slot->queue, slot, 1);
+	}
+
+	// After a short read, the end of the file is usually next. Then the whole
+	// file is in memory and can be parsed in place.
+	if (first->length < URING_BUFFER_SIZE) {
+		if (uring_settle(slot)) PF_FAIL_ERRNO(&pp);
+		slot->whole = slot->buffers[1].state == BUFFER_FILLED &&
+		              slot->buffers[1].length == 0;
+	}
+
+	if (buffer_is_gzip(&pp)) {
+		// Let the regular input layer deal with compressed files.
+		if (uring_settle(slot)) PF_FAIL_ERRNO(&pp);
+		int file_descriptor = dup(slot->file_descriptor);
+		if (file_descriptor < 0) PF_FAIL_ERRNO(&pp);
+		if (lseek(file_descriptor, 0, SEEK_SET) != 0) {
+			close(file_descriptor);
+			PF_FAIL_ERRNO(&pp);
+		}
+
+		pfasta_free(&pp);
+		pp = pfasta_init(file_descriptor);
+		if (pp.errstr) {
+			close(file_descriptor);
 		} else {
-			check = skip_whitespace(pp);
-			if (UNLIKELY(check == E_EOF)) break;
-			PF_FAIL_BUBBLE_CHECK(pp, check);
+			pp.owns_descriptor = 1;
 		}
+		return pp;
 	}
 
-	if (dynstr_len(&sequence) == 0)
-		PF_FAIL_STR(pp, "Empty sequence on line %zu.", pp->line_number);
+	int check = parser_check_start(&pp);
+	PF_FAIL_BUBBLE_CHECK(&pp, check);
 
-	pr->sequence_length = dynstr_len(&sequence);
-	pr->sequence = dynstr_move(&sequence);
-	pp->errstr = NULL; // reset error
+cleanup:
+	if (return_code) {
+		if (!pp.uring) uring_release(slot);
+		pfasta_free(&pp);
+	}
+	pp.done = return_code || buffer_is_eof(&pp);
+	return pp;
+}
+
+/** @brief Stop all outstanding operations and close the files opened ahead. */
+static void uring_drain(struct pfasta_queue_state *st) {
+	struct uring_ring *ring = st->ring;
+
+	while (ring->in_flight) {
+		if (uring_wait(st)) break;
+	}
+
+	for (size_t i = 0; i < URING_DEPTH; i++) {
+		struct pfasta_uring_slot *slot = &st->slots[i];
+		if (slot->state == FILE_READY && !slot->error) {
+			close(slot->file_descriptor);
+		}
+	}
+}
+
+#else
+
+static struct uring_ring *uring_setup(unsigned entries) {
+	(void)entries;
+	return NULL;
+}
+
+static void uring_free(struct uring_ring *ring) { (void)ring; }
+
+static ssize_t uring_next(struct pfasta_parser *pp) {
+	(void)pp;
+	errno = ENOSYS;
+	return -1;
+}
+
+static void uring_release(struct pfasta_uring_slot *slot) { (void)slot; }
+
+static int uring_is_whole(const struct pfasta_uring_slot *slot) {
+	(void)slot;
+	return 0;
+}
+
+static void uring_fill(struct pfasta_queue_state *st) { (void)st; }
+
+static struct pfasta_parser uring_attach(struct pfasta_uring_slot *slot) {
+	(void)slot;
+	return (struct pfasta_parser){.errstr = "io_uring is not supported."};
+}
+
+static void uring_drain(struct pfasta_queue_state *st) { (void)st; }
+
+#endif
+
+struct pfasta_queue pfasta_queue_init(char *const *file_names, size_t count) {
+	int return_code = 0;
+	struct pfasta_queue queue = {0};
+
+	struct pfasta_queue_state *st = calloc(1, sizeof(*st));
+	if (!st) PF_FAIL_ERRNO(&queue);
+	queue.state = st;
+
+	st->file_names = file_names;
+	st->count = count;
+
+	// Opening ahead only pays off with more than one file.
+	if (count > 1) st->ring = uring_setup(2 * URING_DEPTH);
+	if (!st->ring) goto cleanup;
+
+	for (size_t i = 0; i < URING_DEPTH; i++) {
+		struct pfasta_uring_slot *slot = &st->slots[i];
+		slot->queue = st;
+		for (size_t j = 0; j < 2; j++) {
+			slot->buffers[j].data = malloc(URING_BUFFER_SIZE);
+			if (!slot->buffers[j].data) PF_FAIL_ERRNO(&queue);
+		}
+	}
+
+	uring_fill(st);
 
 cleanup:
 	if (return_code) {
-		dynstr_free(&sequence);
+		pfasta_queue_free(&queue);
 	}
-	return return_code;
+	return queue;
 }
 
-void pfasta_record_free(struct pfasta_record *pr) {
-	if (!pr) return;
-	free(pr->name);
-	free(pr->comment);
-	free(pr->sequence);
-	pr->name = pr->comment = pr->sequence = NULL;
+struct pfasta_parser pfasta_queue_next(struct pfasta_queue *queue) {
+	int return_code = 0;
+	struct pfasta_parser pp = {0};
+	struct pfasta_queue_state *st = queue->state;
+
+	if (st->next_file >= st->count) PF_FAIL_STR_CONST(&pp, "No more files.");
+	size_t file = st->next_file++;
+	const char *file_name = st->file_names[file];
+
+	if (st->ring) {
+		for (size_t i = 0; i < URING_DEPTH; i++) {
+			struct pfasta_uring_slot *slot = &st->slots[i];
+			if (slot->state != FILE_IDLE && slot->state != FILE_ATTACHED &&
+			    slot->file == file) {
+				return uring_attach(slot);
+			}
+		}
+
+		// All slots are taken by parsers that are still alive. Do not open
+		// this file ahead anymore.
+		if (st->next_open <= file) st->next_open = file + 1;
+	}
+
+	if (strcmp(file_name, "-") == 0) return pfasta_init(STDIN_FILENO);
+
+	int file_descriptor = open(file_name, O_RDONLY | O_CLOEXEC);
+	if (file_descriptor < 0) PF_FAIL_ERRNO(&pp);
+
+	pp = pfasta_init(file_descriptor);
+	if (pp.errstr) {
+		close(file_descriptor);
+	} else {
+		pp.owns_descriptor = 1;
+	}
+
+cleanup:
+	if (return_code) pp.done = 1;
+	return pp;
 }
 
-void pfasta_free(struct pfasta_parser *pp) {
-	if (!pp) return;
-	free(pp->buffer);
-	pp->buffer = NULL;
+void pfasta_queue_free(struct pfasta_queue *queue) {
+	if (!queue || !queue->state) return;
+	struct pfasta_queue_state *st = queue->state;
+
+	if (st->ring) {
+		uring_drain(st);
+		uring_free(st->ring);
+	}
+
+	for (size_t i = 0; i < URING_DEPTH; i++) {
+		free(st->slots[i].buffers[0].data);
+		free(st->slots[i].buffers[1].data);
+	}
+	free(st);
+	queue->state = NULL;
 }
 
-/** @brief Creates a new string that can grow dynamically.
- *
- * @param ds - A reference to the dynstr container.
- *
- * @returns 0 iff successful.
+/** The input of a push parser is collected in one growing buffer. Records up
+ * to `boundary` are complete, as the next one has started already; they are
+ * parsed in place by a parser on that range. The rest waits for more input.
  */
-static inline int dynstr_init(dynstr *ds, struct pfasta_parser *pp) {
+struct pfasta_feed_state {
+	char *data;
+	size_t length, capacity;
+	size_t begin;    // start of the records not yet read
+	size_t boundary; // end of the complete records
+	size_t scanned;  // everything before was searched for record starts
+	size_t end;      // end of the range of the parser
+	size_t line_number;
+	int ended;
+	int active; // parser walks [begin, end)
+	struct pfasta_parser parser;
+};
+
+/** @brief Stop parsing the current range, but remember how far it got. The
+ * parser points into the buffer and would not survive it being moved.
+ */
+static void feed_detach(struct pfasta_feed_state *st) {
+	if (!st->active) return;
+
+	// At EOF, the read pointer does not point into the range anymore and the
+	// last newline may not have been counted.
+	if (st->parser.done) {
+		st->line_number +=
+		    count_newlines(st->data + st->begin, st->data + st->end);
+		st->begin = st->end;
+	} else {
+		st->begin = st->parser.read_ptr - st->data;
+		st->line_number = st->parser.line_number;
+	}
+	pfasta_free(&st->parser);
+	st->active = 0;
+}
+
+/** @brief Move the boundary behind the last complete record. A record is
+ * complete, once a '>' at the beginning of a line follows it.
+ */
+static void feed_scan(struct pfasta_feed_state *st) {
+	size_t pos = st->scanned ? st->scanned : 1;
+	while (pos < st->length) {
+		const char *found = memchr(st->data + pos, '>', st->length - pos);
+		if (!found) break;
+
+		pos = found - st->data;
+		if (st->data[pos - 1] == '\n') st->boundary = pos;
+		pos++;
+	}
+	st->scanned = st->length;
+}
+
+struct pfasta_feed pfasta_feed_init(void) {
 	int return_code = 0;
+	struct pfasta_feed pf = {0};
 
-	*ds = (dynstr){NULL, 0, 0};
-	ds->str = malloc(61);
-	if (!ds->str) PF_FAIL_ERRNO(pp);
+	struct pfasta_feed_state *st = calloc(1, sizeof(*st));
+	if (!st) PF_FAIL_ERRNO(&pf);
+	st->line_number = 1;
+	pf.state = st;
 
-	ds->str[0] = '\0';
-	ds->capacity = 61;
-	ds->count = 0;
+cleanup:
+	pf.done = return_code;
+	return pf;
+}
+
+int pfasta_feed(struct pfasta_feed *pf, const char *data, size_t length) {
+	int return_code = 0;
+	struct pfasta_feed_state *st = pf->state;
+	PF_FAIL_BUBBLE(pf);
+
+	if (st->ended) PF_FAIL_STR_CONST(pf, "Input has already ended.");
+
+	if (length > st->capacity - st->length && st->begin > 0) {
+		feed_detach(st);
+
+		// Drop what was read already, before growing the buffer.
+		memmove(st->data, st->data + st->begin, st->length - st->begin);
+		st->length -= st->begin;
+		st->boundary -= st->begin;
+		st->scanned -= st->begin;
+		st->begin = 0;
+	}
+
+	if (length > st->capacity - st->length) {
+		feed_detach(st);
+
+		size_t capacity = st->capacity ? st->capacity : BUFFER_SIZE;
+		while (capacity - st->length < length) {
+			if (capacity > SIZE_MAX / 2) {
+				errno = ENOMEM;
+				PF_FAIL_ERRNO(pf);
+			}
+			capacity *= 2;
+		}
+
+		char *neu = realloc(st->data, capacity);
+		if (!neu) PF_FAIL_ERRNO(pf);
+		st->data = neu;
+		st->capacity = capacity;
+	}
+
+	if (length) memcpy(st->data + st->length, data, length);
+	st->length += length;
+
+	feed_scan(st);
 
 cleanup:
+	if (return_code) pf->done = 1;
 	return return_code;
 }
 
-/** @brief A append more than one character to a string.
- *
- * @param ds - A reference to the dynstr container.
- * @param str - The new characters.
- * @param length - number of new characters to append
- *
- * @returns 0 iff successful.
- */
-static inline int dynstr_append(dynstr *ds, const char *str, size_t length,
-                                struct pfasta_parser *pp) {
+void pfasta_feed_end(struct pfasta_feed *pf) {
+	if (pf->state) pf->state->ended = 1;
+}
+
+struct pfasta_record pfasta_feed_read(struct pfasta_feed *pf) {
 	int return_code = 0;
-	size_t required = ds->count + length;
+	struct pfasta_record pr = {0};
+	struct pfasta_feed_state *st = pf->state;
+	PF_FAIL_BUBBLE(pf);
 
-	if (UNLIKELY(required >= ds->capacity)) {
-		char *neu = pfasta_reallocarray(ds->str, required / 2, 3);
-		if (UNLIKELY(!neu)) {
-			dynstr_free(ds);
-			PF_FAIL_ERRNO(pp);
+	if (!st->active) {
+		st->end = st->ended ? st->length : st->boundary;
+		if (st->begin == st->end) {
+			// Let an empty input fail just like an empty file.
+			if (!st->ended || st->length) goto cleanup;
 		}
-		ds->str = neu;
-		ds->capacity = (required / 2) * 3;
+
+		st->parser = parser_init_range(st->data + st->begin,
+		                               st->data + st->end, st->line_number);
+		st->active = 1;
 	}
 
-	memcpy(ds->str + ds->count, str, length);
-	ds->count = required;
+	const char *start = st->parser.read_ptr;
+	size_t line_number = st->parser.line_number;
+
+	pr = pfasta_read(&st->parser);
+	if (st->parser.errstr) {
+		// The parser has freed itself. Read the record once more without the
+		// artificial end of the range, so that the error is the same as for a
+		// file.
+		st->active = 0;
+		pf->errstr = st->parser.errstr;
+
+		if (st->end < st->length && *start == '>') {
+			struct pfasta_parser cp = parser_init_range(
+			    start, st->data + st->length, line_number);
+			struct pfasta_record again = pfasta_read(&cp);
+			pfasta_record_free(&again);
+			if (cp.errstr) pf->errstr = cp.errstr;
+			pfasta_free(&cp);
+		}
+
+		return_code = E_BUBBLE;
+		goto cleanup;
+	}
+
+cleanup:
+	if (st && st->active && st->parser.done) feed_detach(st);
+	if (return_code || (st->ended && !st->active && st->begin == st->length)) {
+		pf->done = 1;
+	}
+	return pr;
+}
+
+void pfasta_feed_free(struct pfasta_feed *pf) {
+	if (!pf || !pf->state) return;
+	struct pfasta_feed_state *st = pf->state;
+
+	if (st->active) pfasta_free(&st->parser);
+	free(st->data);
+	free(st);
+	pf->state = NULL;
+}
+
+/** Output is collected in a buffer of this size before it is written. */
+#define WRITER_BUFFER_SIZE (1 << 18)
+
+struct pfasta_writer pfasta_writer_init(int file_descriptor, int line_length) {
+	int return_code = 0;
+	struct pfasta_writer pw = {0};
+	pw.file_descriptor = file_descriptor;
+	pw.line_length = line_length > 0 ? line_length : 0;
+
+	pw.buffer = malloc(WRITER_BUFFER_SIZE);
+	if (!pw.buffer) PF_FAIL_ERRNO(&pw);
+
+cleanup:
+	if (return_code) {
+		pfasta_writer_free(&pw);
+	}
+	return pw;
+}
+
+/** @brief Write all of `data` to the file, however many calls that takes. */
+static int writer_write(struct pfasta_writer *pw, const char *data,
+                        size_t length) {
+	int return_code = 0;
+
+	while (length) {
+		ssize_t written = write(pw->file_descriptor, data, length);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			PF_FAIL_ERRNO(pw);
+		}
+		data += written;
+		length -= written;
+	}
 
 cleanup:
 	return return_code;
 }
 
-/** @brief Frees a dynamic string. */
-static inline void dynstr_free(dynstr *ds) {
-	if (!ds) return;
-	free(ds->str);
-	*ds = (dynstr){NULL, 0, 0};
+int pfasta_writer_flush(struct pfasta_writer *pw) {
+	int return_code = 0;
+	PF_FAIL_BUBBLE(pw);
+
+	int check = writer_write(pw, pw->buffer, pw->fill);
+	PF_FAIL_BUBBLE_CHECK(pw, check);
+	pw->fill = 0;
+
+cleanup:
+	return return_code;
 }
 
-/** @brief Returns the string as a standard `char*`. The internal reference is
- * then deleted. Hence the name *move* as in *move semantics*.
+/** @brief Make room for `length` more bytes in the buffer.
  *
- * @param ds - The dynamic string to move from.
- *
- * @returns a `char*` to a standard null-terminated string.
+ * @returns 0 iff successful. Afterwards, data of at least the buffer size has
+ * to be written directly.
  */
-static inline char *dynstr_move(dynstr *ds) {
-	char *out = pfasta_reallocarray(ds->str, ds->count + 1, 1);
-	if (!out) {
-		out = ds->str;
+static int writer_reserve(struct pfasta_writer *pw, size_t length) {
+	int return_code = 0;
+
+	if (UNLIKELY(length > WRITER_BUFFER_SIZE - pw->fill)) {
+		int check = pfasta_writer_flush(pw);
+		PF_FAIL_BUBBLE_CHECK(pw, check);
 	}
-	out[ds->count] = '\0';
-	*ds = (dynstr){NULL, 0, 0};
-	return out;
+
+cleanup:
+	return return_code;
 }
 
-/** @brief Returns the current length of the dynamic string. */
-static inline size_t dynstr_len(const dynstr *ds) { return ds->count; }
+/** @brief Append a piece of output to the buffer, as is. */
+static int writer_append(struct pfasta_writer *pw, const char *data,
+                         size_t length) {
+	int return_code = 0;
+
+	int check = writer_reserve(pw, length);
+	PF_FAIL_BUBBLE_CHECK(pw, check);
+
+	if (UNLIKELY(length >= WRITER_BUFFER_SIZE)) {
+		check = writer_write(pw, data, length);
+		PF_FAIL_BUBBLE_CHECK(pw, check);
+	} else {
+		memcpy(pw->buffer + pw->fill, data, length);
+		pw->fill += length;
+	}
+
+cleanup:
+	return return_code;
+}
+
+int pfasta_write_header(struct pfasta_writer *pw,
+                        const struct pfasta_view *pv) {
+	int return_code = 0;
+	PF_FAIL_BUBBLE(pw);
+
+	int check = writer_append(pw, ">", 1);
+	PF_FAIL_BUBBLE_CHECK(pw, check);
+	check = writer_append(pw, pv->name.data, pv->name.length);
+	PF_FAIL_BUBBLE_CHECK(pw, check);
+	if (pv->comment.data) {
+		check = writer_append(pw, " ", 1);
+		PF_FAIL_BUBBLE_CHECK(pw, check);
+		check = writer_append(pw, pv->comment.data, pv->comment.length);
+		PF_FAIL_BUBBLE_CHECK(pw, check);
+	}
+	check = writer_append(pw, "\n", 1);
+	PF_FAIL_BUBBLE_CHECK(pw, check);
+	pw->column = 0;
+
+cleanup:
+	return return_code;
+}
+
+int pfasta_write_chunk(struct pfasta_writer *pw, const char *chunk,
+                       size_t length) {
+	int return_code = 0;
+	int check;
+	PF_FAIL_BUBBLE(pw);
+
+	if (!pw->line_length) {
+		check = writer_append(pw, chunk, length);
+		PF_FAIL_BUBBLE_CHECK(pw, check);
+		pw->column += length;
+		length = 0;
+	}
+
+	// Copy line by line, each followed by a newline.
+	while (length) {
+		size_t room = pw->line_length - pw->column;
+		size_t n = length < room ? length : room;
+
+		check = writer_reserve(pw, n + 1);
+		PF_FAIL_BUBBLE_CHECK(pw, check);
+		if (UNLIKELY(n >= WRITER_BUFFER_SIZE)) {
+			check = writer_write(pw, chunk, n);
+			PF_FAIL_BUBBLE_CHECK(pw, check);
+		} else {
+			memcpy(pw->buffer + pw->fill, chunk, n);
+			pw->fill += n;
+		}
+
+		pw->column += n;
+		if (pw->column == pw->line_length) {
+			pw->buffer[pw->fill++] = '\n';
+			pw->column = 0;
+		}
+
+		chunk += n;
+		length -= n;
+	}
+
+cleanup:
+	return return_code;
+}
+
+int pfasta_write_end(struct pfasta_writer *pw) {
+	int return_code = 0;
+	PF_FAIL_BUBBLE(pw);
+
+	// A full line has its newline already.
+	if (pw->column) {
+		int check = writer_append(pw, "\n", 1);
+		PF_FAIL_BUBBLE_CHECK(pw, check);
+		pw->column = 0;
+	}
+
+cleanup:
+	return return_code;
+}
+
+int pfasta_write(struct pfasta_writer *pw, const struct pfasta_record *pr) {
+	int return_code = 0;
+
+	struct pfasta_view pv = {
+	    .name = {pr->name, pr->name_length},
+	    .comment = {pr->comment, pr->comment_length},
+	};
+	int check = pfasta_write_header(pw, &pv);
+	PF_FAIL_BUBBLE_CHECK(pw, check);
+
+	check = pfasta_write_chunk(pw, pr->sequence, pr->sequence_length);
+	PF_FAIL_BUBBLE_CHECK(pw, check);
+
+	check = pfasta_write_end(pw);
+	PF_FAIL_BUBBLE_CHECK(pw, check);
+
+cleanup:
+	return return_code;
+}
+
+void pfasta_writer_free(struct pfasta_writer *pw) {
+	if (!pw) return;
+	free(pw->buffer);
+	pw->buffer = NULL;
+	pw->fill = pw->column = 0;
+}
 
 __attribute__((weak)) void *reallocarray(void *ptr, size_t nmemb, size_t size);
 
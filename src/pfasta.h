@@ -23,15 +23,203 @@ extern "C" {
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 
 /**
  * There is no magic to this structure. Its just a container of three strings.
  * Feel free to duplicate or move them. But don't forget to free the data after
  * usage!
+ *
+ * The capacities tell `pfasta_read_into` how much memory is available for
+ * reuse. If you replace one of the strings, set its capacity to zero.
  */
 struct pfasta_record {
 	char *name, *comment, *sequence;
 	size_t name_length, comment_length, sequence_length;
+	size_t name_capacity, comment_capacity, sequence_capacity;
+};
+
+/**
+ * A span is a borrowed piece of memory: `length` characters starting at
+ * `data`. The characters are not necessarily null-terminated and must not be
+ * freed.
+ */
+struct pfasta_span {
+	const char *data;
+	size_t length;
+};
+
+/**
+ * A view is a record whose strings are borrowed from the parser. It stays valid
+ * until the next read from the same parser or until the parser is freed. The
+ * comment has a `data` pointer of NULL iff the record has no comment.
+ */
+struct pfasta_view {
+	struct pfasta_span name, comment, sequence;
+};
+
+/**
+ * A run of `length` positions starting at `start`. In the exceptions of a
+ * packed sequence, `base` is the character at all of these positions, in
+ * upper case; otherwise it is zero.
+ */
+struct pfasta_run {
+	size_t start, length;
+	char base;
+};
+
+/**
+ * A sequence of `length` bases packed into two bits each. A, C, T and G are
+ * coded as 0, 1, 2 and 3, so that xor 2 gives the complement. Base i is stored
+ * in bits 2(i%32) and 2(i%32)+1 of `words[i/32]`. Everything other than ACGT,
+ * like N, is listed in `exceptions` and coded as 0. Lower case (soft-masked)
+ * letters are listed in `masks`. Both lists are sorted and merge adjacent
+ * positions. Initialize with zeros and free with `pfasta_packed_free`.
+ */
+struct pfasta_packed {
+	uint64_t *words;
+	size_t length;
+	struct pfasta_run *exceptions, *masks;
+	size_t exception_count, mask_count;
+
+	/*< private -- do not touch! >*/
+	size_t word_capacity, exception_capacity, mask_capacity;
+};
+
+/**
+ * Optional modes of operation for a parser. See `pfasta_set_flags`.
+ */
+enum {
+	/**
+	 * Parse in two stages: First, classify a whole window of input into
+	 * bitmaps of whitespace, newlines and record starts using SIMD. Then,
+	 * slice names and sequence lines by walking those bitmaps. This makes the
+	 * cost of parsing mostly independent of the line width.
+	 */
+	PFASTA_STRUCTURAL = 1,
+	/**
+	 * Only for `pfasta_parallel_init`: Hand out the records of a chunk as soon
+	 * as it is parsed, instead of in the order of the file.
+	 */
+	PFASTA_UNORDERED = 2,
+	/**
+	 * Read ahead on a separate thread into a ring of large buffers, so that
+	 * waiting for slow storage overlaps with parsing. This only affects input
+	 * that is read rather than memory-mapped, e.g. pipes and sockets, and
+	 * stays on for the rest of the parse once enabled.
+	 */
+	PFASTA_READAHEAD = 4,
+	/**
+	 * The following flags translate the residues of sequences while they are
+	 * copied out of the input; names and comments stay as they are. Without
+	 * validation, the byte 0xFF comes out as `!`. This one turns lower case
+	 * letters into upper case.
+	 */
+	PFASTA_UPPERCASE = 8,
+	/** Drop all residues but A, C, G and T in either case. */
+	PFASTA_ACGT = 16,
+	/**
+	 * Fail on residues that are neither IUPAC nucleotide codes in either case,
+	 * nor the gaps `-` and `.`. This applies before any other translation.
+	 */
+	PFASTA_VALIDATE_IUPAC = 32,
+	/** Replace soft-masked, i.e. lower case, residues by N. */
+	PFASTA_MASK_LOWERCASE = 64,
+};
+
+/**
+ * Special entries of a translation table. See `pfasta_set_table`.
+ */
+enum { PFASTA_DROP = 0, PFASTA_REJECT = 0xFF };
+
+/**
+ * A batch is a number of records that share a single allocation for all their
+ * strings. The records belong to the batch: do not free them individually or
+ * pass them to `pfasta_read_into`, but free the whole batch with
+ * `pfasta_batch_free`.
+ */
+struct pfasta_batch {
+	struct pfasta_record *records;
+	size_t count;
+
+	/*< private -- do not touch! >*/
+	char *arena;
+};
+
+/**
+ * One line of a .fai index: the name of a record, its number of bases, the
+ * offset of its first base in the file, and the number of bases and bytes per
+ * line.
+ */
+struct pfasta_index_entry {
+	char *name;
+	size_t length, offset, line_bases, line_bytes;
+};
+
+/*< private -- do not touch! >*/
+struct pfasta_bgzf_block;
+
+/**
+ * A samtools-compatible index of a FASTA file. It allows fetching parts of a
+ * sequence without reading the file up to that point. Iff an error occurred
+ * `errstr` is set to contain a suitable message. `compressed` is set for
+ * BGZF-compressed files; offsets then refer to the decompressed data.
+ */
+struct pfasta_index {
+	const char *errstr;
+	struct pfasta_index_entry *entries;
+	size_t count;
+	int compressed;
+
+	/*< private -- do not touch! >*/
+	int file_descriptor;
+	size_t capacity;
+	size_t *slots;
+	size_t slot_count;
+	struct pfasta_bgzf_block *blocks;
+	size_t block_count;
+	unsigned char *scratch;
+};
+
+/**
+ * Counters of a parser, as returned by `pfasta_get_stats`. Byte counts refer to
+ * the decompressed input. `bytes_read` is what was put into the buffer and
+ * `bytes` what the parser has consumed of it. `reads` counts refills of the
+ * buffer; a mapped file is available at once and needs none. A refill is
+ * `mid_record_refills` unless it happens right between two records. `reallocs`
+ * and `bytes_copied` are the growth of strings and the bytes copied into them.
+ * `io_nanoseconds` is the time spent waiting for input; the rest of
+ * `elapsed_nanoseconds` since the parser was set up went into parsing and the
+ * caller's own work.
+ */
+struct pfasta_stats {
+	size_t bytes, bytes_read, reads, mid_record_refills;
+	size_t reallocs, bytes_copied;
+	size_t records, lines;
+	uint64_t io_nanoseconds, elapsed_nanoseconds;
+};
+
+/*< private -- do not touch! >*/
+struct pfasta_structure;
+
+/*< private -- do not touch! >*/
+struct pfasta_transform;
+
+/*< private -- do not touch! >*/
+struct pfasta_inflate;
+
+/*< private -- do not touch! >*/
+struct pfasta_readahead;
+
+/*< private -- do not touch! >*/
+struct pfasta_uring_slot;
+
+/*< private -- do not touch! >*/
+struct pfasta_dynstr {
+	char *str;
+	size_t capacity, count;
+	const char *borrowed;
+	int borrow;
 };
 
 /**
@@ -45,9 +233,87 @@ struct pfasta_parser {
 
 	/*< private -- do not touch! >*/
 	int file_descriptor;
+	int backend;
+	int flags;
 	char *buffer;
 	char *read_ptr, *fill_ptr;
+	size_t mapped_length;
 	size_t line_number;
+	struct pfasta_dynstr scratch_name, scratch_comment, scratch_sequence;
+	struct pfasta_structure *structure;
+	struct pfasta_inflate *inflate;
+	struct pfasta_readahead *readahead;
+	struct pfasta_uring_slot *uring;
+	int owns_descriptor;
+	int chunk_state;
+	size_t released;
+	struct pfasta_transform *transform;
+	struct pfasta_stats stats;
+	uint64_t started;
+};
+
+/*< private -- do not touch! >*/
+struct pfasta_parallel_state;
+
+/*< private -- do not touch! >*/
+struct pfasta_queue_state;
+
+/**
+ * A queue of files to be parsed one after the other. On Linux, the upcoming
+ * files are opened and read ahead via io_uring. Iff an error occurred `errstr`
+ * is set to contain a suitable message.
+ */
+struct pfasta_queue {
+	const char *errstr;
+
+	/*< private -- do not touch! >*/
+	struct pfasta_queue_state *state;
+};
+
+/*< private -- do not touch! >*/
+struct pfasta_feed_state;
+
+/**
+ * A parser that is pushed its input in pieces of any size instead of reading it
+ * by itself. Iff an error occurred `errstr` is set to contain a suitable
+ * message. `done` is set once the input has ended and all records were read.
+ */
+struct pfasta_feed {
+	const char *errstr;
+	int done;
+
+	/*< private -- do not touch! >*/
+	struct pfasta_feed_state *state;
+};
+
+/**
+ * A writer of FASTA records with sequences wrapped to a fixed line length.
+ * Output is collected in a large buffer, which is written out once it is full
+ * and by `pfasta_writer_flush`. Iff an error occurred `errstr` is set to
+ * contain a suitable message; all further writes are ignored then.
+ */
+struct pfasta_writer {
+	const char *errstr;
+
+	/*< private -- do not touch! >*/
+	int file_descriptor;
+	size_t line_length;
+	size_t column;
+	char *buffer;
+	size_t fill;
+};
+
+/**
+ * A parser that splits a file into chunks and parses these on multiple threads.
+ * It is used just like `pfasta_parser`: read from it as long as `done` isn't
+ * set and check `errstr` after every call.
+ */
+struct pfasta_parallel {
+	const char *errstr;
+	int done;
+
+	/*< private -- do not touch! >*/
+	struct pfasta_parallel_state *state;
 };
 
 /**
@@ -58,9 +324,37 @@ struct pfasta_parser {
  *
  * Please note that the user is responsible for opening the file descriptor as
  * readable and closing after usage.
+ *
+ * If the file descriptor refers to a regular file, the file is memory-mapped
+ * and parsed in place. Pipes, terminals and other streams are read in chunks.
+ * A mapped file must not be truncated before `pfasta_free` is called.
  */
 struct pfasta_parser pfasta_init(int file_descriptor);
 
+/**
+ * Set up a parser on `length` bytes of FASTA at `data`. Nothing is copied: the
+ * memory has to stay valid and unchanged until the parser is freed, and the
+ * names of views point right into it.
+ */
+struct pfasta_parser pfasta_init_mem(const char *data, size_t length);
+
+/**
+ * Change the mode of operation of a parser to the given combination of flags.
+ * This can be done at any time between reads. Returns 0 iff successful;
+ * otherwise, the parser continues to work as before.
+ */
+int pfasta_set_flags(struct pfasta_parser *pp, int flags);
+
+/**
+ * Translate every residue `c` of the following sequences to `table[c]`, as
+ * it is copied out of the input. Residues that map to `PFASTA_DROP` are
+ * removed; one that maps to `PFASTA_REJECT` fails the parse. The table of 256
+ * entries is copied. Pass NULL to stop translating. Setting any of the
+ * translating flags with `pfasta_set_flags` replaces the table. Returns 0 iff
+ * successful.
+ */
+int pfasta_set_table(struct pfasta_parser *pp, const unsigned char *table);
+
 /**
  * Using a properly initialized parser, this function can read FASTA sequences.
  * These are stored in the simple structure and returned. On error, the `errstr`
@@ -68,6 +362,284 @@ struct pfasta_parser pfasta_init(int file_descriptor);
  */
 struct pfasta_record pfasta_read(struct pfasta_parser *pp);
 
+/**
+ * Read the next record into an existing one. All strings of `pr` are reused
+ * and only grown if they are too small; thus, a loop over a file does not
+ * allocate in the steady state. Initialize the record with zeros before the
+ * first call and free it with `pfasta_record_free` after the last one. If the
+ * new record has no comment, the old comment is freed and set to NULL.
+ *
+ * Returns 0 iff successful. On error, the `errstr` property of the parser is
+ * set and the parser is freed, but the record still needs to be freed.
+ */
+int pfasta_read_into(struct pfasta_parser *pp, struct pfasta_record *pr);
+
+/**
+ * Read the next record without taking ownership of its strings. Instead of
+ * allocating new memory for every record, the parser reuses its internal
+ * storage. For memory-mapped files the name and comment point directly into
+ * the file. Everything in the returned view is invalidated by the next read.
+ * On error, the `errstr` property of the parser is set.
+ */
+struct pfasta_view pfasta_read_view(struct pfasta_parser *pp);
+
+/**
+ * Read only the name and comment of the next record, so that its sequence can
+ * be read in pieces by `pfasta_read_chunk`. The view stays valid until the
+ * next header is read; its sequence is empty. If the previous sequence was not
+ * read up to its end, the rest of it is skipped. Should that have been the last
+ * record, `done` is set and the view is empty. On error, the `errstr` property
+ * of the parser is set.
+ */
+struct pfasta_view pfasta_read_header(struct pfasta_parser *pp);
+
+/**
+ * Copy up to `size` residues of the sequence of the current record to
+ * `buffer`. The sequence has ended when zero is returned; then read the next
+ * header, unless `done` is set. Thus, reading a record takes memory bounded
+ * by the size of the buffer, no matter how long the sequence is. Do not mix
+ * this with other reads within a record. On error, zero is returned and the
+ * `errstr` property of the parser is set.
+ */
+size_t pfasta_read_chunk(struct pfasta_parser *pp, char *buffer, size_t size);
+
+/**
+ * Skip the rest of the sequence of the current record and return the number
+ * of residues skipped, as they appear in the input; a translation is not
+ * applied. Nothing is copied or allocated, so scanning for names and lengths
+ * is about as fast as reading the file. The sequence is checked just like by
+ * the other reads. On error, zero is returned and the `errstr` property of the
+ * parser is set.
+ */
+size_t pfasta_skip_sequence(struct pfasta_parser *pp);
+
+/**
+ * Read the sequence of the current record, after `pfasta_read_header`, into a
+ * packed sequence. The memory of `pk` is reused, so that a loop over a file
+ * does not allocate in the steady state. Returns 0 iff successful; otherwise,
+ * the `errstr` property of the parser is set.
+ */
+int pfasta_read_packed(struct pfasta_parser *pp, struct pfasta_packed *pk);
+
+/**
+ * Write the characters from `start` up to, but excluding, `end` of a packed
+ * sequence to `buffer`, exactly as they were read. The range is clipped to the
+ * length of the sequence. Returns the number of characters written; no null
+ * byte is added.
+ */
+size_t pfasta_packed_unpack(const struct pfasta_packed *pk, size_t start,
+                            size_t end, char *buffer);
+
+/**
+ * Replace a packed sequence by its complement, in place. Exceptions are
+ * complemented according to IUPAC.
+ */
+void pfasta_packed_complement(struct pfasta_packed *pk);
+
+/**
+ * Count the Cs and Gs of a packed sequence, in either case.
+ */
+size_t pfasta_packed_gc(const struct pfasta_packed *pk);
+
+/**
+ * Count the positions at which two packed sequences differ, up to the length of
+ * the shorter one. Characters are compared exactly, i.e. including exceptions
+ * and case.
+ */
+size_t pfasta_packed_mismatches(const struct pfasta_packed *a,
+                                const struct pfasta_packed *b);
+
+/**
+ * Free the memory held by a packed sequence.
+ */
+void pfasta_packed_free(struct pfasta_packed *pk);
+
+/**
+ * Read up to `max_records` records at once, but stop after the first record
+ * that brings the total size of all strings to `max_bytes` or more. A limit of
+ * zero means no limit. All strings of the batch live in one contiguous arena.
+ * On error, the `errstr` property of the parser is set and the batch contains
+ * the records before the error, or none if memory ran out. Either way, the
+ * batch needs to be freed.
+ */
+struct pfasta_batch pfasta_read_batch(struct pfasta_parser *pp,
+                                      size_t max_records, size_t max_bytes);
+
+/**
+ * Free a batch of records together with all of its strings.
+ */
+void pfasta_batch_free(struct pfasta_batch *pb);
+
+/**
+ * Set up a parser that is fed its input piece by piece. Free it after usage.
+ */
+struct pfasta_feed pfasta_feed_init(void);
+
+/**
+ * Append `length` bytes to the input of a push parser. The data is copied, so
+ * the pieces may be cut anywhere, even within a record. Returns 0 iff
+ * successful; otherwise, the `errstr` property of the parser is set.
+ */
+int pfasta_feed(struct pfasta_feed *pf, const char *data, size_t length);
+
+/**
+ * Tell a push parser that there is no more input. Only then is the last record
+ * considered complete.
+ */
+void pfasta_feed_end(struct pfasta_feed *pf);
+
+/**
+ * Read the next complete record from a push parser. If more input is needed,
+ * all strings of the returned record are NULL; feed more and try again. The
+ * record is owned by the caller. On error, the `errstr` property of the
+ * parser is set.
+ */
+struct pfasta_record pfasta_feed_read(struct pfasta_feed *pf);
+
+/**
+ * Free the resources held by a push parser.
+ */
+void pfasta_feed_free(struct pfasta_feed *pf);
+
+/**
+ * Set up a writer to the given file descriptor. Sequences are wrapped after
+ * `line_length` residues; zero or less puts every sequence on a single line.
+ * Free the writer after usage.
+ */
+struct pfasta_writer pfasta_writer_init(int file_descriptor, int line_length);
+
+/**
+ * Write a whole record. Only the lengths of its strings are used, so they need
+ * not be terminated. Returns 0 iff successful; otherwise, the `errstr`
+ * property of the writer is set.
+ */
+int pfasta_write(struct pfasta_writer *pw, const struct pfasta_record *pr);
+
+/**
+ * Write the header line of a record. Its sequence follows in pieces of any
+ * size via `pfasta_write_chunk`, and is completed by `pfasta_write_end`.
+ * Returns 0 iff successful.
+ */
+int pfasta_write_header(struct pfasta_writer *pw, const struct pfasta_view *pv);
+int pfasta_write_chunk(struct pfasta_writer *pw, const char *chunk,
+                       size_t length);
+int pfasta_write_end(struct pfasta_writer *pw);
+
+/**
+ * Write out everything that is still in the buffer. This has to be done before
+ * the file descriptor is closed. Returns 0 iff successful.
+ */
+int pfasta_writer_flush(struct pfasta_writer *pw);
+
+/**
+ * Free the resources held by a writer. Output that was not flushed is lost.
+ */
+void pfasta_writer_free(struct pfasta_writer *pw);
+
+/**
+ * Build the index of a FASTA file by scanning it from the beginning. All lines
+ * of a record have to be of the same length, except for the last one. The file
+ * descriptor has to stay open for `pfasta_fetch`. A BGZF-compressed file is
+ * indexed in the same pass as its blocks; plain gzip files cannot be indexed.
+ */
+struct pfasta_index pfasta_index_build(int file_descriptor);
+
+/**
+ * Load an index for the FASTA file `file_descriptor` from a .fai file opened as
+ * `index_descriptor`. The latter may be closed afterwards. If the FASTA file is
+ * BGZF-compressed, the block offsets have to be loaded as well, using
+ * `pfasta_index_load_gzi`.
+ */
+struct pfasta_index pfasta_index_load(int file_descriptor,
+                                      int index_descriptor);
+
+/**
+ * Load the block offsets of a BGZF-compressed file from a .gzi file opened as
+ * `gzi_descriptor`. Returns 0 iff successful; otherwise, the `errstr` property
+ * of the index is set.
+ */
+int pfasta_index_load_gzi(struct pfasta_index *index, int gzi_descriptor);
+
+/**
+ * Write an index in .fai format. Returns 0 iff successful; otherwise, the
+ * `errstr` property of the index is set.
+ */
+int pfasta_index_write(struct pfasta_index *index, int index_descriptor);
+
+/**
+ * Write the block offsets of a compressed file in .gzi format. Returns 0 iff
+ * successful; otherwise, the `errstr` property of the index is set.
+ */
+int pfasta_index_write_gzi(struct pfasta_index *index, int gzi_descriptor);
+
+/**
+ * Fetch the bases from `start` up to, but excluding, `end` of the sequence
+ * called `name`. Positions are zero-based and clipped to the length of the
+ * sequence. The result is a null-terminated string to be freed by the caller.
+ * On error, NULL is returned and the `errstr` property of the index is set.
+ * For compressed files only the blocks covering the range are decompressed.
+ */
+char *pfasta_fetch(struct pfasta_index *index, const char *name, size_t start,
+                   size_t end);
+
+/**
+ * This function frees the resources held by an index.
+ */
+void pfasta_index_free(struct pfasta_index *index);
+
+/**
+ * Set up a queue for parsing the `count` files in `file_names`, in order. A
+ * name of `-` stands for standard input. The names are used as given and have
+ * to stay valid until the queue is freed. Where io_uring is unavailable, the
+ * files are simply opened one at a time.
+ */
+struct pfasta_queue pfasta_queue_init(char *const *file_names, size_t count);
+
+/**
+ * Get a parser for the next file of the queue. It is used like one from
+ * `pfasta_init`, except that the queue owns the file descriptor: `pfasta_free`
+ * closes it. If the file cannot be opened, `errstr` of the parser is set. Free
+ * each parser before asking for the next one, so that its buffers can be used
+ * for the files ahead, and all of them before the queue.
+ */
+struct pfasta_parser pfasta_queue_next(struct pfasta_queue *queue);
+
+/**
+ * Free a queue along with the files it opened ahead.
+ */
+void pfasta_queue_free(struct pfasta_queue *queue);
+
+/**
+ * Set up a parser that works on `threads` threads at once (zero means one per
+ * CPU). The file is cut into chunks of about `chunk_size` bytes (zero picks a
+ * default of 16 MiB) at record boundaries. Combine `flags` from the enum
+ * above; with `PFASTA_UNORDERED` records are returned as soon as they are
+ * available, otherwise in the order of the file. Error messages, including
+ * line numbers, are the same as those of `pfasta_read`.
+ *
+ * Only memory-mapped files can be split. For all other input, or with a single
+ * thread, this falls back to a sequential parser.
+ */
+struct pfasta_parallel pfasta_parallel_init(int file_descriptor, size_t threads,
+                                            size_t chunk_size, int flags);
+
+/**
+ * Read the next record from a parallel parser. The record is owned by the
+ * caller. On error, the `errstr` property of the parser is set.
+ */
+struct pfasta_record pfasta_parallel_read(struct pfasta_parallel *pp);
+
+/**
+ * Stop all threads and free the resources held by a parallel parser.
+ */
+void pfasta_parallel_free(struct pfasta_parallel *pp);
+
+/**
+ * Get the counters of a parser. They may be read at any time, even after an
+ * error, but not after the parser was freed.
+ */
+struct pfasta_stats pfasta_get_stats(const struct pfasta_parser *pp);
+
 /**
  * This function frees the resources held by a pfasta record.
  */
@@ -0,0 +1,81 @@
+/*
+ * Allocation profiler, to be preloaded into a tool:
+ *
+ *     PFASTA_ALLOCS=allocs.tsv LD_PRELOAD=./allocs.so ./format file.fa
+ *
+ * It counts the allocations, frees, reallocations and requested bytes of the
+ * whole process. At exit, these are appended to the file named by
+ * PFASTA_ALLOCS as one tab separated line, after the name of the program.
+ * Allocations made by the C library on behalf of the program, e.g. by strdup,
+ * asprintf or fopen, are counted, too.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifndef __GLIBC__
+#error "The allocation profiler interposes the allocator of glibc."
+#endif
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static size_t allocations, frees, reallocs, bytes;
+
+// The parser may run threads, e.g. for decompression.
+#define COUNT(COUNTER, N) __atomic_fetch_add(&(COUNTER), (N), __ATOMIC_RELAXED)
+
+void *malloc(size_t size) {
+	COUNT(allocations, 1);
+	COUNT(bytes, size);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+	COUNT(allocations, 1);
+	COUNT(bytes, nmemb * size);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	COUNT(*(ptr ? &reallocs : &allocations), 1);
+	COUNT(bytes, size);
+	return __libc_realloc(ptr, size);
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size) {
+	if (size && nmemb > (size_t)-1 / size) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	return realloc(ptr, nmemb * size);
+}
+
+void free(void *ptr) {
+	if (ptr) COUNT(frees, 1);
+	__libc_free(ptr);
+}
+
+__attribute__((destructor)) static void report(void) {
+	const char *file_name = getenv("PFASTA_ALLOCS");
+	if (!file_name) return;
+
+	// Formatted on the stack, so that reporting does not allocate.
+	char line[256];
+	int length = snprintf(line, sizeof(line), "%s\t%zu\t%zu\t%zu\t%zu\n",
+	                      program_invocation_short_name, allocations, frees,
+	                      reallocs, bytes);
+
+	int file_descriptor =
+	    open(file_name, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (file_descriptor < 0) return;
+	if (write(file_descriptor, line, length) != length) {
+		perror(file_name);
+	}
+	close(file_descriptor);
+}
@@ -0,0 +1,803 @@
+/*
+ * Differential test: parse a file with every API and every parser mode, read
+ * from the file itself as well as from a pipe, and make sure that all of them
+ * agree on the records and on the error message. The parallel parser is run
+ * with tiny chunks, so that even the small test files get split up. The same
+ * goes for a buffer in memory and for a push parser fed in small pieces. Then,
+ * gzip and BGZF compressed copies have to parse the same. Finally, all files
+ * are parsed through a queue, which opens and reads them ahead. Sequences
+ * translated by the parser have to match a translation of the plain records.
+ * Names and lengths also have to come out the same when sequences are skipped.
+ * Records put out by the writer, at any line length, have to parse back the
+ * same. Once a parser is done, its statistics have to account for all records and
+ * all input. Last, a parser reading ahead has to be freeable in the middle of a
+ * long input.
+ */
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "compress.h"
+#include "pfasta.h"
+
+enum {
+	API_READ,
+	API_READ_INTO,
+	API_READ_VIEW,
+	API_READ_BATCH,
+	API_READ_CHUNK,
+	API_READ_PACKED,
+	API_COUNT
+};
+
+static const int modes[] = {0, PFASTA_STRUCTURAL, PFASTA_READAHEAD,
+                            PFASTA_STRUCTURAL | PFASTA_READAHEAD};
+static const size_t num_modes = sizeof(modes) / sizeof(modes[0]);
+
+enum { SCAN_READ, SCAN_SKIP, SCAN_HEAD, SCAN_COUNT };
+
+static const int transforms[] = {
+    PFASTA_UPPERCASE, PFASTA_ACGT, PFASTA_MASK_LOWERCASE,
+    PFASTA_MASK_LOWERCASE | PFASTA_ACGT,
+    PFASTA_VALIDATE_IUPAC | PFASTA_UPPERCASE};
+static const size_t num_transforms = sizeof(transforms) / sizeof(transforms[0]);
+
+static int stats_failures = 0;
+
+static const int line_lengths[] = {0, 1, 7, 80};
+static const size_t num_line_lengths =
+    sizeof(line_lengths) / sizeof(line_lengths[0]);
+
+static const size_t chunk_sizes[] = {1, 7, 64};
+static const size_t num_chunk_sizes =
+    sizeof(chunk_sizes) / sizeof(chunk_sizes[0]);
+
+static void emit(FILE *out, const char *name, size_t name_length,
+                 const char *comment, size_t comment_length,
+                 const char *sequence, size_t sequence_length) {
+	fprintf(out, ">%.*s", (int)name_length, name);
+	if (comment) fprintf(out, " %.*s", (int)comment_length, comment);
+	fprintf(out, "\n%.*s\n", (int)sequence_length, sequence);
+}
+
+/** Open the file directly or, if `use_pipe` is set, through a pipe. */
+int open_input(const char *file_name, int use_pipe) {
+	int file_descriptor = open(file_name, O_RDONLY);
+	if (file_descriptor < 0) err(1, "%s", file_name);
+	if (!use_pipe) return file_descriptor;
+
+	int filedes[2];
+	if (pipe(filedes) == -1) err(errno, "pipe");
+
+	pid_t pid = fork();
+	if (pid == -1) err(errno, "fork");
+	if (pid == 0) {
+		close(filedes[0]);
+		char buffer[4096];
+		ssize_t bytes;
+		while ((bytes = read(file_descriptor, buffer, sizeof(buffer))) > 0) {
+			if (write(filedes[1], buffer, bytes) != bytes) _exit(1);
+		}
+		_exit(0);
+	}
+
+	close(filedes[1]);
+	close(file_descriptor);
+	return filedes[0];
+}
+
+char *parse_parallel(const char *file_name, int mode, int use_pipe,
+                     size_t chunk_size) {
+	char *result = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&result, &size);
+	if (!out) err(errno, "open_memstream");
+
+	int file_descriptor = open_input(file_name, use_pipe);
+
+	struct pfasta_parallel pp =
+	    pfasta_parallel_init(file_descriptor, 3, chunk_size, mode);
+
+	while (!pp.errstr && !pp.done) {
+		struct pfasta_record pr = pfasta_parallel_read(&pp);
+		if (pp.errstr) break;
+		emit(out, pr.name, pr.name_length, pr.comment, pr.comment_length,
+		     pr.sequence, pr.sequence_length);
+		pfasta_record_free(&pr);
+	}
+
+	if (pp.errstr) fprintf(out, "error: %s\n", pp.errstr);
+
+	pfasta_parallel_free(&pp);
+	close(file_descriptor);
+	if (use_pipe) wait(NULL);
+	fclose(out);
+	return result;
+}
+
+/** Check the helpers on packed sequences against the plain characters. */
+int check_packed(struct pfasta_packed *pk, const char *sequence,
+                 struct pfasta_packed *previous, const char *previous_sequence) {
+	size_t gc = 0;
+	for (size_t i = 0; i < pk->length; i++) {
+		gc += strchr("cCgG", sequence[i]) && sequence[i];
+	}
+	if (pfasta_packed_gc(pk) != gc) return -1;
+
+	if (previous_sequence) {
+		size_t length = pk->length < previous->length ? pk->length
+		                                              : previous->length;
+		size_t mismatches = 0;
+		for (size_t i = 0; i < length; i++) {
+			mismatches += sequence[i] != previous_sequence[i];
+		}
+		if (pfasta_packed_mismatches(pk, previous) != mismatches) return -1;
+	}
+
+	// Unpack odd pieces, and the complement of the complement.
+	char *buffer = malloc(pk->length + 1);
+	if (!buffer) err(errno, "malloc");
+	for (size_t start = 0; start < pk->length; start += 37) {
+		pfasta_packed_unpack(pk, start, start + 37, buffer + start);
+	}
+	pfasta_packed_complement(pk);
+	pfasta_packed_complement(pk);
+	char *again = malloc(pk->length + 1);
+	if (!again) err(errno, "malloc");
+	pfasta_packed_unpack(pk, 0, pk->length, again);
+
+	int check = memcmp(buffer, sequence, pk->length) ||
+	            memcmp(again, sequence, pk->length);
+	free(buffer);
+	free(again);
+	return check ? -1 : 0;
+}
+
+/** Print all records of the parser, or the error that stopped it. */
+void dump(FILE *out, struct pfasta_parser *pp, int api) {
+	struct pfasta_record pr = {0};
+	struct pfasta_packed packed[2] = {{0}};
+	char *unpacked[2] = {NULL};
+	size_t n = 0, records = 0;
+	while (!pp->errstr && !pp->done) {
+		if (api == API_READ) {
+			pr = pfasta_read(pp);
+			if (pp->errstr) break;
+			emit(out, pr.name, pr.name_length, pr.comment, pr.comment_length,
+			     pr.sequence, pr.sequence_length);
+			records++;
+			pfasta_record_free(&pr);
+		} else if (api == API_READ_INTO) {
+			if (pfasta_read_into(pp, &pr)) break;
+			emit(out, pr.name, pr.name_length, pr.comment, pr.comment_length,
+			     pr.sequence, pr.sequence_length);
+			records++;
+		} else if (api == API_READ_BATCH) {
+			// Small limits, so that files span several batches.
+			struct pfasta_batch pb = pfasta_read_batch(pp, 2, 64);
+			records += pb.count;
+			for (size_t i = 0; i < pb.count; i++) {
+				struct pfasta_record *rec = &pb.records[i];
+				emit(out, rec->name, rec->name_length, rec->comment,
+				     rec->comment_length, rec->sequence, rec->sequence_length);
+			}
+			pfasta_batch_free(&pb);
+		} else if (api == API_READ_CHUNK) {
+			struct pfasta_view pv = pfasta_read_header(pp);
+			if (pp->errstr) break;
+
+			// Tiny pieces, so that they end anywhere within a line.
+			char *sequence = NULL;
+			size_t length = 0;
+			FILE *seq = open_memstream(&sequence, &length);
+			if (!seq) err(errno, "open_memstream");
+
+			char chunk[5];
+			size_t count;
+			while ((count = pfasta_read_chunk(pp, chunk, sizeof(chunk)))) {
+				fwrite(chunk, 1, count, seq);
+			}
+			fclose(seq);
+
+			if (!pp->errstr) {
+				emit(out, pv.name.data, pv.name.length, pv.comment.data,
+				     pv.comment.length, sequence, length);
+				records++;
+			}
+			free(sequence);
+		} else if (api == API_READ_PACKED) {
+			struct pfasta_view pv = pfasta_read_header(pp);
+			if (pp->errstr) break;
+
+			// Alternate between two packed sequences to compare them.
+			struct pfasta_packed *pk = &packed[n % 2];
+			if (pfasta_read_packed(pp, pk)) break;
+
+			free(unpacked[n % 2]);
+			unpacked[n % 2] = malloc(pk->length + 1);
+			if (!unpacked[n % 2]) err(errno, "malloc");
+			pfasta_packed_unpack(pk, 0, pk->length, unpacked[n % 2]);
+
+			if (check_packed(pk, unpacked[n % 2], &packed[(n + 1) % 2],
+			                 unpacked[(n + 1) % 2])) {
+				fprintf(out, "packed helpers disagree\n");
+			}
+			emit(out, pv.name.data, pv.name.length, pv.comment.data,
+			     pv.comment.length, unpacked[n % 2], pk->length);
+			records++;
+			n++;
+		} else {
+			struct pfasta_view pv = pfasta_read_view(pp);
+			if (pp->errstr) break;
+			emit(out, pv.name.data, pv.name.length, pv.comment.data,
+			     pv.comment.length, pv.sequence.data, pv.sequence.length);
+			records++;
+		}
+	}
+
+	if (pp->errstr) fprintf(out, "error: %s\n", pp->errstr);
+
+	struct pfasta_stats stats = pfasta_get_stats(pp);
+	if (!pp->errstr && (stats.records != records ||
+	                    stats.bytes != stats.bytes_read || !stats.lines)) {
+		warnx("api %d: statistics disagree: %zu of %zu records, %zu of %zu "
+		      "bytes",
+		      api, stats.records, records, stats.bytes, stats.bytes_read);
+		stats_failures++;
+	}
+
+	pfasta_record_free(&pr);
+	for (size_t i = 0; i < 2; i++) {
+		pfasta_packed_free(&packed[i]);
+		free(unpacked[i]);
+	}
+}
+
+char *parse(const char *file_name, int api, int mode, int use_pipe) {
+
+	char *result = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&result, &size);
+	if (!out) err(errno, "open_memstream");
+
+	int file_descriptor = open_input(file_name, use_pipe);
+
+	struct pfasta_parser pp = pfasta_init(file_descriptor);
+	if (!pp.errstr && pfasta_set_flags(&pp, mode) != 0) {
+		errx(1, "%s: cannot set mode %d", file_name, mode);
+	}
+
+	dump(out, &pp, api);
+
+	pfasta_free(&pp);
+	close(file_descriptor);
+	if (use_pipe) wait(NULL);
+	fclose(out);
+	return result;
+}
+
+/** List the names and, if `with_lengths` is set, the sequence lengths of a
+ * file. Depending on `scan`, the sequences are read, skipped, or skipped after
+ * reading their first residues. Without lengths, the parser has to skip the
+ * rest of a sequence on its own, when reading the next header.
+ */
+char *parse_lengths(const char *file_name, int scan, int with_lengths,
+                    int mode, int use_pipe) {
+	char *result = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&result, &size);
+	if (!out) err(errno, "open_memstream");
+
+	int file_descriptor = open_input(file_name, use_pipe);
+	struct pfasta_parser pp = pfasta_init(file_descriptor);
+	if (!pp.errstr && pfasta_set_flags(&pp, mode) != 0) {
+		errx(1, "%s: cannot set mode %d", file_name, mode);
+	}
+
+	while (!pp.errstr && !pp.done) {
+		size_t length = 0;
+		if (scan == SCAN_READ) {
+			struct pfasta_record pr = pfasta_read(&pp);
+			if (pp.errstr) break;
+			emit(out, pr.name, pr.name_length, pr.comment, pr.comment_length,
+			     "", 0);
+			length = pr.sequence_length;
+			pfasta_record_free(&pr);
+		} else {
+			struct pfasta_view pv = pfasta_read_header(&pp);
+			if (pp.errstr || pp.done) break;
+			if (!with_lengths) {
+				emit(out, pv.name.data, pv.name.length, pv.comment.data,
+				     pv.comment.length, "", 0);
+			}
+
+			char head[5];
+			if (scan == SCAN_HEAD) {
+				length = pfasta_read_chunk(&pp, head, sizeof(head));
+			}
+			if (with_lengths && !pp.errstr) {
+				length += pfasta_skip_sequence(&pp);
+			}
+			if (pp.errstr) break;
+			if (with_lengths) {
+				emit(out, pv.name.data, pv.name.length, pv.comment.data,
+				     pv.comment.length, "", 0);
+			}
+		}
+		if (with_lengths) fprintf(out, "%zu\n", length);
+	}
+
+	if (pp.errstr) fprintf(out, "error: %s\n", pp.errstr);
+	pfasta_free(&pp);
+	close(file_descriptor);
+	if (use_pipe) wait(NULL);
+	fclose(out);
+	return result;
+}
+
+/** What the parser should make of residue `c`; -1 means dropped. */
+static int transform_residue(int c, int transform) {
+	int lower = c >= 'a' && c <= 'z';
+	if ((transform & PFASTA_MASK_LOWERCASE) && lower) c = 'N';
+	if ((transform & PFASTA_UPPERCASE) && lower) c -= 'a' - 'A';
+	if ((transform & PFASTA_ACGT) && (!c || !strchr("ACGTacgt", c))) return -1;
+	if (c == PFASTA_REJECT) c = '!';
+	return c;
+}
+
+/** Parse a file plainly and translate the sequences afterwards. Validation
+ * is left out; it is only compared between the modes.
+ */
+char *parse_transformed(const char *file_name, int transform) {
+	char *result = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&result, &size);
+	if (!out) err(errno, "open_memstream");
+
+	int file_descriptor = open_input(file_name, 0);
+	struct pfasta_parser pp = pfasta_init(file_descriptor);
+
+	while (!pp.errstr && !pp.done) {
+		struct pfasta_record pr = pfasta_read(&pp);
+		if (pp.errstr) break;
+
+		size_t length = 0;
+		for (size_t i = 0; i < pr.sequence_length; i++) {
+			unsigned char residue = pr.sequence[i];
+			int c = transform_residue(residue, transform);
+			if (c >= 0) pr.sequence[length++] = c;
+		}
+		emit(out, pr.name, pr.name_length, pr.comment, pr.comment_length,
+		     pr.sequence, length);
+		pfasta_record_free(&pr);
+	}
+
+	if (pp.errstr) fprintf(out, "error: %s\n", pp.errstr);
+	pfasta_free(&pp);
+	close(file_descriptor);
+	fclose(out);
+	return result;
+}
+
+/** Read a whole file into memory. */
+char *slurp(const char *file_name, size_t *length) {
+	char *data = NULL;
+	*length = 0;
+	FILE *out = open_memstream(&data, length);
+	if (!out) err(errno, "open_memstream");
+
+	FILE *in = fopen(file_name, "r");
+	if (!in) err(errno, "%s", file_name);
+
+	char buffer[4096];
+	size_t bytes;
+	while ((bytes = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+		fwrite(buffer, 1, bytes, out);
+	}
+
+	fclose(in);
+	fclose(out);
+	return data;
+}
+
+char *parse_mem(const char *file_name, int api, int mode) {
+	char *result = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&result, &size);
+	if (!out) err(errno, "open_memstream");
+
+	size_t length;
+	char *data = slurp(file_name, &length);
+
+	struct pfasta_parser pp = pfasta_init_mem(data, length);
+	if (!pp.errstr && pfasta_set_flags(&pp, mode) != 0) {
+		errx(1, "%s: cannot set mode %d", file_name, mode);
+	}
+
+	dump(out, &pp, api);
+
+	pfasta_free(&pp);
+	free(data);
+	fclose(out);
+	return result;
+}
+
+/** Push the file into a parser in pieces of `chunk_size` bytes. */
+char *parse_feed(const char *file_name, size_t chunk_size) {
+	char *result = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&result, &size);
+	if (!out) err(errno, "open_memstream");
+
+	size_t length;
+	char *data = slurp(file_name, &length);
+
+	struct pfasta_feed pf = pfasta_feed_init();
+	size_t offset = 0;
+	while (!pf.errstr && !pf.done) {
+		struct pfasta_record pr = pfasta_feed_read(&pf);
+		if (pf.errstr) break;
+
+		if (pr.name) {
+			emit(out, pr.name, pr.name_length, pr.comment,
+			     pr.comment_length, pr.sequence, pr.sequence_length);
+			pfasta_record_free(&pr);
+		} else if (offset < length) {
+			size_t bytes = length - offset;
+			if (bytes > chunk_size) bytes = chunk_size;
+			pfasta_feed(&pf, data + offset, bytes);
+			offset += bytes;
+		} else {
+			pfasta_feed_end(&pf);
+		}
+	}
+
+	if (pf.errstr) fprintf(out, "error: %s\n", pf.errstr);
+
+	pfasta_feed_free(&pf);
+	free(data);
+	fclose(out);
+	return result;
+}
+
+/** Whether a sequence still parses when wrapped, i.e. every residue may start
+ * a line.
+ */
+static int wrappable(const char *sequence, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		int c = (unsigned char)sequence[i];
+		if (!(isalpha(c) || c == '-' || c == '*')) return 0;
+	}
+	return 1;
+}
+
+/** Write all records of a file with the given line length and parse them back.
+ * Every other record is written in pieces of a few bytes. Returns NULL if the
+ * sequences cannot be wrapped.
+ */
+char *parse_written(const char *file_name, int line_length) {
+	FILE *tmp = tmpfile();
+	if (!tmp) err(errno, "tmpfile");
+	int written = fileno(tmp);
+
+	int file_descriptor = open_input(file_name, 0);
+	struct pfasta_parser pp = pfasta_init(file_descriptor);
+	struct pfasta_writer pw = pfasta_writer_init(written, line_length);
+
+	int skipped = 0;
+	for (size_t n = 0; !pp.errstr && !pp.done && !skipped; n++) {
+		struct pfasta_record pr = pfasta_read(&pp);
+		if (pp.errstr) break;
+
+		if (line_length && !wrappable(pr.sequence, pr.sequence_length)) {
+			skipped = 1;
+		} else if (n % 2 == 0) {
+			pfasta_write(&pw, &pr);
+		} else {
+			struct pfasta_view pv = {
+			    .name = {pr.name, pr.name_length},
+			    .comment = {pr.comment, pr.comment_length},
+			};
+			pfasta_write_header(&pw, &pv);
+			for (size_t i = 0; i < pr.sequence_length; i += 5) {
+				size_t rest = pr.sequence_length - i;
+				pfasta_write_chunk(&pw, pr.sequence + i, rest < 5 ? rest : 5);
+			}
+			pfasta_write_end(&pw);
+		}
+		pfasta_record_free(&pr);
+	}
+
+	if (pfasta_writer_flush(&pw)) errx(1, "%s: %s", file_name, pw.errstr);
+	pfasta_writer_free(&pw);
+	pfasta_free(&pp);
+	close(file_descriptor);
+
+	if (skipped) {
+		fclose(tmp);
+		return NULL;
+	}
+
+	char *result = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&result, &size);
+	if (!out) err(errno, "open_memstream");
+
+	lseek(written, 0, SEEK_SET);
+	pp = pfasta_init(written);
+	dump(out, &pp, API_READ);
+	pfasta_free(&pp);
+
+	fclose(tmp);
+	fclose(out);
+	return result;
+}
+
+/** Free a parser in readahead mode in the middle of an input that fills all of
+ * its buffers. The reader thread must not keep waiting for a free buffer.
+ */
+int free_readahead_midway(void) {
+	int failures = 0;
+	int filedes[2];
+	if (pipe(filedes) == -1) err(errno, "pipe");
+
+	pid_t pid = fork();
+	if (pid == -1) err(errno, "fork");
+	if (pid == 0) {
+		close(filedes[0]);
+		static const char header[] = ">a\nACGT\n>b\n";
+		if (write(filedes[1], header, sizeof(header) - 1) < 0) _exit(1);
+
+		// 16 MiB of sequence, far more than the reader may buffer.
+		char line[4096];
+		memset(line, 'A', sizeof(line) - 1);
+		line[sizeof(line) - 1] = '\n';
+		for (size_t i = 0; i < (16 << 20) / sizeof(line); i++) {
+			if (write(filedes[1], line, sizeof(line)) < 0) _exit(0);
+		}
+		_exit(0);
+	}
+	close(filedes[1]);
+
+	// A hang is a failure, too.
+	alarm(30);
+
+	struct pfasta_parser pp = pfasta_init(filedes[0]);
+	if (pp.errstr || pfasta_set_flags(&pp, PFASTA_READAHEAD)) {
+		errx(1, "readahead: cannot set up the parser");
+	}
+
+	struct pfasta_record pr = pfasta_read(&pp);
+	if (pp.errstr || strcmp(pr.name, "a") != 0) {
+		warnx("readahead: first record differs");
+		failures++;
+	}
+	pfasta_record_free(&pr);
+
+	// Let the reader fill all of its buffers before the parser goes away.
+	usleep(100000);
+	pfasta_free(&pp);
+	alarm(0);
+
+	close(filedes[0]);
+	waitpid(pid, NULL, 0);
+	return failures;
+}
+
+/** Parse all files through one queue, which opens and reads them ahead. */
+int compare_queue(char *const *file_names, size_t count, int api) {
+	int failures = 0;
+
+	struct pfasta_queue queue = pfasta_queue_init(file_names, count);
+	if (queue.errstr) errx(1, "queue: %s", queue.errstr);
+
+	for (size_t i = 0; i < count; i++) {
+		char *result = NULL;
+		size_t size = 0;
+		FILE *out = open_memstream(&result, &size);
+		if (!out) err(errno, "open_memstream");
+
+		struct pfasta_parser pp = pfasta_queue_next(&queue);
+		dump(out, &pp, api);
+		pfasta_free(&pp);
+		fclose(out);
+
+		char *expected = parse(file_names[i], API_READ, 0, 0);
+		if (strcmp(expected, result) != 0) {
+			warnx("%s: queue, api %d differs", file_names[i], api);
+			failures++;
+		}
+		free(expected);
+		free(result);
+	}
+
+	pfasta_queue_free(&queue);
+	return failures;
+}
+
+int main(int argc, char *argv[]) {
+	int failures = 0;
+
+	for (int i = 1; i < argc; i++) {
+		char *expected = parse(argv[i], API_READ, 0, 0);
+
+		for (int api = 0; api < API_COUNT; api++) {
+			for (size_t m = 0; m < num_modes; m++) {
+				for (int use_pipe = 0; use_pipe < 2; use_pipe++) {
+					char *actual = parse(argv[i], api, modes[m], use_pipe);
+					if (strcmp(expected, actual) != 0) {
+						warnx("%s: api %d, mode %d, pipe %d differs", argv[i],
+						      api, modes[m], use_pipe);
+						failures++;
+					}
+					free(actual);
+				}
+			}
+		}
+
+		for (size_t m = 0; m < num_modes; m++) {
+			for (size_t c = 0; c < num_chunk_sizes; c++) {
+				for (int use_pipe = 0; use_pipe < 2; use_pipe++) {
+					char *actual = parse_parallel(argv[i], modes[m], use_pipe,
+					                              chunk_sizes[c]);
+					if (strcmp(expected, actual) != 0) {
+						warnx("%s: parallel, mode %d, chunk size %zu, pipe %d "
+						      "differs",
+						      argv[i], modes[m], chunk_sizes[c], use_pipe);
+						failures++;
+					}
+					free(actual);
+				}
+			}
+		}
+
+		for (int api = 0; api < API_COUNT; api++) {
+			for (size_t m = 0; m < num_modes; m++) {
+				char *actual = parse_mem(argv[i], api, modes[m]);
+				if (strcmp(expected, actual) != 0) {
+					warnx("%s: memory, api %d, mode %d differs", argv[i], api,
+					      modes[m]);
+					failures++;
+				}
+				free(actual);
+			}
+		}
+
+		for (size_t c = 0; c < num_chunk_sizes; c++) {
+			char *actual = parse_feed(argv[i], chunk_sizes[c]);
+			if (strcmp(expected, actual) != 0) {
+				warnx("%s: feed, chunk size %zu differs", argv[i],
+				      chunk_sizes[c]);
+				failures++;
+			}
+			free(actual);
+		}
+
+		for (int with_lengths = 0; with_lengths < 2; with_lengths++) {
+			// A header may now come before the error in its sequence.
+			int reference = with_lengths ? SCAN_READ : SCAN_SKIP;
+			char *listed =
+			    parse_lengths(argv[i], reference, with_lengths, 0, 0);
+
+			for (int scan = SCAN_SKIP; scan < SCAN_COUNT; scan++) {
+				for (size_t m = 0; m < num_modes; m++) {
+					for (int use_pipe = 0; use_pipe < 2; use_pipe++) {
+						char *actual = parse_lengths(argv[i], scan, with_lengths,
+						                             modes[m], use_pipe);
+						if (strcmp(listed, actual) != 0) {
+							warnx("%s: scan %d, lengths %d, mode %d, pipe %d "
+							      "differs",
+							      argv[i], scan, with_lengths, modes[m],
+							      use_pipe);
+							failures++;
+						}
+						free(actual);
+					}
+				}
+			}
+			free(listed);
+		}
+
+		// Only valid records get written.
+		for (size_t l = 0; !strstr(expected, "error: ") &&
+		                   l < num_line_lengths; l++) {
+			char *actual = parse_written(argv[i], line_lengths[l]);
+			if (actual && strcmp(expected, actual) != 0) {
+				warnx("%s: written with line length %d differs", argv[i],
+				      line_lengths[l]);
+				failures++;
+			}
+			free(actual);
+		}
+
+		for (size_t t = 0; t < num_transforms; t++) {
+			int transform = transforms[t];
+			char *translated =
+			    transform & PFASTA_VALIDATE_IUPAC
+			        ? parse(argv[i], API_READ, transform, 0)
+			        : parse_transformed(argv[i], transform);
+
+			for (int api = 0; api < API_COUNT; api++) {
+				for (int use_pipe = 0; use_pipe < 2; use_pipe++) {
+					int mode = transform | (use_pipe ? PFASTA_STRUCTURAL : 0);
+					char *actual = parse(argv[i], api, mode, use_pipe);
+					if (strcmp(translated, actual) != 0) {
+						warnx("%s: transform %d, api %d, pipe %d differs",
+						      argv[i], transform, api, use_pipe);
+						failures++;
+					}
+					free(actual);
+
+					actual = parse_mem(argv[i], api, mode);
+					if (strcmp(translated, actual) != 0) {
+						warnx("%s: memory, transform %d, api %d differs",
+						      argv[i], transform, api);
+						failures++;
+					}
+					free(actual);
+				}
+			}
+
+			char *actual = parse_parallel(argv[i], transform, 0, 7);
+			if (strcmp(translated, actual) != 0) {
+				warnx("%s: parallel, transform %d differs", argv[i],
+				      transform);
+				failures++;
+			}
+			free(actual);
+			free(translated);
+		}
+
+#ifdef WITH_ZLIB
+		for (int format = 0; format < FORMAT_COUNT; format++) {
+			char *compressed = compress_file(argv[i], format);
+			for (int api = 0; api < API_COUNT; api++) {
+				for (int use_pipe = 0; use_pipe < 2; use_pipe++) {
+					char *actual = parse(compressed, api, 0, use_pipe);
+					if (strcmp(expected, actual) != 0) {
+						warnx("%s: compression %d, api %d, pipe %d differs",
+						      argv[i], format, api, use_pipe);
+						failures++;
+					}
+					free(actual);
+				}
+			}
+			unlink(compressed);
+			free(compressed);
+		}
+#endif
+
+		free(expected);
+	}
+
+	for (int api = 0; api < API_COUNT; api++) {
+		failures += compare_queue(argv + 1, argc - 1, api);
+	}
+
+#ifdef WITH_ZLIB
+	// Compressed files leave the queue for the regular input layer.
+	char **compressed = calloc(argc, sizeof(*compressed));
+	if (!compressed) err(errno, "calloc");
+	for (int i = 1; i < argc; i++) {
+		compressed[i - 1] = compress_file(argv[i], i % FORMAT_COUNT);
+	}
+	failures += compare_queue(compressed, argc - 1, API_READ);
+	for (int i = 0; i < argc - 1; i++) {
+		unlink(compressed[i]);
+		free(compressed[i]);
+	}
+	free(compressed);
+#endif
+
+	failures += free_readahead_midway();
+	failures += stats_failures;
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
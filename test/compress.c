@@ -0,0 +1,100 @@
+/*
+ * Write gzip and BGZF compressed copies of test files.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "compress.h"
+
+#ifdef WITH_ZLIB
+
+/** Deflate `length` bytes with the given zlib window bits. */
+static size_t deflate_all(const char *data, size_t length, int window_bits,
+                          unsigned char *out, size_t capacity) {
+	z_stream zs = {0};
+	if (deflateInit2(&zs, 6, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY))
+		errx(1, "deflateInit2 failed");
+
+	zs.next_in = (unsigned char *)data;
+	zs.avail_in = length;
+	zs.next_out = out;
+	zs.avail_out = capacity;
+	if (deflate(&zs, Z_FINISH) != Z_STREAM_END) errx(1, "deflate failed");
+
+	size_t written = capacity - zs.avail_out;
+	deflateEnd(&zs);
+	return written;
+}
+
+/** Write one BGZF block holding `length` bytes. */
+static void write_bgzf_block(FILE *out, const char *data, size_t length) {
+	unsigned char block[1024];
+	size_t size = deflate_all(data, length, -15, block + 18, sizeof(block) - 26);
+
+	size_t bsize = 18 + size + 8 - 1;
+	unsigned char header[18] = {0x1f, 0x8b, 8,   4,   0, 0, 0,           0, 0,
+	                            0xff, 6,    0, 'B', 'C', 2, 0, bsize & 0xff,
+	                            bsize >> 8};
+	memcpy(block, header, sizeof(header));
+
+	uint32_t crc = crc32(0, (const unsigned char *)data, length);
+	for (int i = 0; i < 4; i++) {
+		block[18 + size + i] = crc >> (8 * i);
+		block[22 + size + i] = length >> (8 * i);
+	}
+
+	fwrite(block, 1, bsize + 1, out);
+}
+
+/** Compress a file into a temporary one and return its name. BGZF blocks are
+ * kept tiny, so that records cross many of them.
+ */
+char *compress_file(const char *file_name, int format) {
+	FILE *in = fopen(file_name, "rb");
+	if (!in) err(1, "%s", file_name);
+
+	char data[65536];
+	size_t length = fread(data, 1, sizeof(data), in);
+	if (!feof(in)) errx(1, "%s: file too large", file_name);
+	fclose(in);
+
+	char *tmp_name = strdup("/tmp/pfasta_test.XXXXXX");
+	int file_descriptor = mkstemp(tmp_name);
+	if (file_descriptor < 0) err(errno, "mkstemp");
+	FILE *out = fdopen(file_descriptor, "wb");
+
+	if (format == FORMAT_GZIP) {
+		static unsigned char compressed[2 * sizeof(data)];
+		size_t size = deflate_all(data, length, 15 + 16, compressed,
+		                          sizeof(compressed));
+		fwrite(compressed, 1, size, out);
+	} else {
+		for (size_t offset = 0; offset < length; offset += 64) {
+			size_t chunk = length - offset < 64 ? length - offset : 64;
+			write_bgzf_block(out, data + offset, chunk);
+		}
+		write_bgzf_block(out, "", 0); // end-of-file marker
+	}
+
+	fclose(out);
+	return tmp_name;
+}
+
+#else
+
+char *compress_file(const char *file_name, int format) {
+	(void)format;
+	errx(1, "%s: compression requires zlib support", file_name);
+}
+
+#endif
@@ -0,0 +1,5 @@
+#pragma once
+
+enum { FORMAT_GZIP, FORMAT_BGZF, FORMAT_COUNT };
+
+char *compress_file(const char *file_name, int format);
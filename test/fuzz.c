@@ -1,26 +1,20 @@
-#include <unistd.h>
-#include <stdlib.h>
-#include <errno.h>
-#include <err.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "pfasta.h"
 
 int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
-	int filedes[2];
-	int check = pipe(filedes);
-	if (check == -1) err(errno, "pipe");
+	const char *data = (const char *)Data;
 
-	ssize_t bytes = write(filedes[1], Data, Size);
-	if (bytes == -1) err(errno, "write failed");
-	close(filedes[1]);
-
-	struct pfasta_parser pp = pfasta_init(filedes[0]);
+	struct pfasta_parser pp = pfasta_init_mem(data, Size);
 	// if (pp.errstr) warn("%s", pp.errstr);
 
+	size_t records = 0;
 	while (!pp.done) {
 		struct pfasta_record pr = pfasta_read(&pp);
 		// if (pp.errstr) warn("%s", pp.errstr);
+		if (!pp.errstr) records++;
 
 		// if (pr.comment) {
 		// 	printf(">%s %s\n%zu\n", pr.name, pr.comment, pr.sequence_length);
@@ -30,8 +24,32 @@ int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
 		pfasta_record_free(&pr);
 	}
 
+	int failed = pp.errstr != NULL;
 	pfasta_free(&pp);
-	close(filedes[0]);
+
+	// Push the same input in pieces; the outcome has to be the same.
+	struct pfasta_feed pf = pfasta_feed_init();
+	size_t chunk_size = Size ? Data[0] % 16 + 1 : 1;
+	size_t offset = 0;
+	while (!pf.errstr && !pf.done) {
+		struct pfasta_record pr = pfasta_feed_read(&pf);
+		if (pf.errstr) break;
+
+		if (pr.name) {
+			records--;
+		} else if (offset < Size) {
+			size_t bytes = Size - offset;
+			if (bytes > chunk_size) bytes = chunk_size;
+			pfasta_feed(&pf, data + offset, bytes);
+			offset += bytes;
+		} else {
+			pfasta_feed_end(&pf);
+		}
+		pfasta_record_free(&pr);
+	}
+
+	if (records != 0 || failed != (pf.errstr != NULL)) abort();
+	pfasta_feed_free(&pf);
 
 	return 0; // Non-zero return values are reserved for future use.
 }
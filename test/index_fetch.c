@@ -0,0 +1,150 @@
+/*
+ * Index a file, write and reload the index, and check that fetching windows
+ * of every record yields the same bases as parsing the whole file. The same
+ * goes for a BGZF-compressed copy, whose blocks are tiny.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "compress.h"
+#include "pfasta.h"
+
+static int failures = 0;
+
+void check_window(struct pfasta_index *index, const struct pfasta_record *pr,
+                  size_t start, size_t end) {
+	char *window = pfasta_fetch(index, pr->name, start, end);
+	if (!window) errx(1, "%s: %s", pr->name, index->errstr);
+
+	size_t clipped_end = end < pr->sequence_length ? end : pr->sequence_length;
+	size_t clipped_start = start < clipped_end ? start : clipped_end;
+	size_t length = clipped_end - clipped_start;
+
+	if (strlen(window) != length ||
+	    memcmp(window, pr->sequence + clipped_start, length) != 0) {
+		warnx("%s: window [%zu, %zu) differs", pr->name, start, end);
+		failures++;
+	}
+
+	free(window);
+}
+
+void check_record(struct pfasta_index *index, const struct pfasta_record *pr) {
+	size_t length = pr->sequence_length;
+	size_t positions[] = {0, 1, 2, 59, 60, 61, 69, 70, 71, length / 2,
+	                      length - 1, length, length + 1};
+	size_t count = sizeof(positions) / sizeof(positions[0]);
+
+	if (length <= 100) {
+		for (size_t start = 0; start <= length + 1; start++) {
+			for (size_t end = start; end <= length + 1; end++) {
+				check_window(index, pr, start, end);
+			}
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		for (size_t j = 0; j < count; j++) {
+			check_window(index, pr, positions[i], positions[j]);
+		}
+	}
+}
+
+void process(const char *file_name) {
+	int file_descriptor = open(file_name, O_RDONLY);
+	if (file_descriptor < 0) err(1, "%s", file_name);
+
+	struct pfasta_index built = pfasta_index_build(file_descriptor);
+	if (built.errstr) errx(1, "%s: %s", file_name, built.errstr);
+
+	// Round trip through the .fai format.
+	FILE *tmp = tmpfile();
+	if (!tmp) err(errno, "tmpfile");
+	if (pfasta_index_write(&built, fileno(tmp))) {
+		errx(1, "%s: %s", file_name, built.errstr);
+	}
+	lseek(fileno(tmp), 0, SEEK_SET);
+
+	struct pfasta_index index = pfasta_index_load(file_descriptor, fileno(tmp));
+	if (index.errstr) errx(1, "%s: %s", file_name, index.errstr);
+	fclose(tmp);
+
+	// Compressed files also round trip their blocks through the .gzi format.
+	if (built.compressed) {
+		tmp = tmpfile();
+		if (!tmp) err(errno, "tmpfile");
+		if (pfasta_index_write_gzi(&built, fileno(tmp))) {
+			errx(1, "%s: %s", file_name, built.errstr);
+		}
+		lseek(fileno(tmp), 0, SEEK_SET);
+
+		if (pfasta_index_load_gzi(&index, fileno(tmp))) {
+			errx(1, "%s: %s", file_name, index.errstr);
+		}
+		fclose(tmp);
+	}
+
+	if (index.count != built.count || index.compressed != built.compressed) {
+		warnx("%s: reloaded index differs", file_name);
+		failures++;
+	}
+
+	struct pfasta_parser pp = pfasta_init(file_descriptor);
+	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
+
+	for (size_t i = 0; !pp.done; i++) {
+		struct pfasta_record pr = pfasta_read(&pp);
+		if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
+
+		if (i >= index.count || strcmp(index.entries[i].name, pr.name) != 0 ||
+		    index.entries[i].length != pr.sequence_length) {
+			warnx("%s: entry %zu differs", file_name, i);
+			failures++;
+		} else {
+			check_record(&index, &pr);
+		}
+
+		pfasta_record_free(&pr);
+	}
+
+	pfasta_free(&pp);
+	pfasta_index_free(&index);
+	pfasta_index_free(&built);
+	close(file_descriptor);
+}
+
+int main(int argc, char *argv[]) {
+	for (int i = 1; i < argc; i++) {
+		process(argv[i]);
+
+#ifdef WITH_ZLIB
+		char *compressed = compress_file(argv[i], FORMAT_BGZF);
+		process(compressed);
+		unlink(compressed);
+		free(compressed);
+
+		// Plain gzip streams cannot be accessed randomly.
+		compressed = compress_file(argv[i], FORMAT_GZIP);
+		int file_descriptor = open(compressed, O_RDONLY);
+		if (file_descriptor < 0) err(1, "%s", compressed);
+		struct pfasta_index index = pfasta_index_build(file_descriptor);
+		if (!index.errstr) {
+			warnx("%s: gzip file was indexed", argv[i]);
+			failures++;
+		}
+		pfasta_index_free(&index);
+		close(file_descriptor);
+		unlink(compressed);
+		free(compressed);
+#endif
+	}
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
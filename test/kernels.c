@@ -0,0 +1,231 @@
+/*
+ * Microbenchmark of the scanning kernels and of the string handling built on
+ * them. The kernels are internal to the library, so its source is included
+ * directly. Each kernel runs in every variant the CPU supports, on buffers
+ * from a few hundred bytes to a few megabytes and with whitespace every
+ * `width` bytes. The best of several runs is reported in cycles per byte, as
+ * counted by the time stamp counter, or in nanoseconds per byte elsewhere.
+ */
+
+#include "pfasta.c"
+
+#include <time.h>
+
+#define ROUNDS 15
+#define MIN_BYTES (1 << 16) // per round, so that tiny buffers can be timed
+
+typedef char *(*find_function)(const char *begin, const char *end);
+typedef size_t (*count_function)(const char *begin, const char *end);
+
+struct isa {
+	const char *name;
+	int supported;
+	find_function find_space, find_not_space;
+	count_function count;
+};
+
+static struct isa isas[] = {
+    {"generic", 1, find_first_space_generic, find_first_not_space_generic,
+     count_newlines_generic},
+#if PF_DISPATCH
+    {"sse2", 0, find_first_space_sse2, find_first_not_space_sse2,
+     count_newlines_sse2},
+    {"avx2", 0, find_first_space_avx2, find_first_not_space_avx2,
+     count_newlines_avx2},
+    {"avx512", 0, find_first_space_avx512, find_first_not_space_avx512,
+     count_newlines_avx512},
+#endif
+};
+static const size_t num_isas = sizeof(isas) / sizeof(isas[0]);
+
+static const size_t sizes[] = {256, 4096, 65536, 4 << 20};
+static const size_t num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+// Zero means no whitespace at all.
+static const size_t widths[] = {2, 8, 61, 81, 1001, 0};
+static const size_t num_widths = sizeof(widths) / sizeof(widths[0]);
+
+struct work {
+	struct isa *isa;
+	const char *begin, *end;
+	size_t width;
+	dynstr target;
+	struct pfasta_parser pp;
+	volatile size_t sink;
+};
+
+static void detect_isas(void) {
+#if PF_DISPATCH
+	__builtin_cpu_init();
+	isas[1].supported = __builtin_cpu_supports("sse2");
+	isas[2].supported = __builtin_cpu_supports("avx2");
+	isas[3].supported = __builtin_cpu_supports("avx512bw");
+#endif
+}
+
+static inline uint64_t ticks(void) {
+#if PF_DISPATCH
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/** Time `run` on a buffer of `bytes` and return the best ticks per byte. */
+static double measure(void (*run)(struct work *), struct work *work,
+                      size_t bytes) {
+	size_t repeats = MIN_BYTES / bytes + 1;
+	uint64_t best = UINT64_MAX;
+
+	for (int round = 0; round < ROUNDS; round++) {
+		uint64_t start = ticks();
+		for (size_t i = 0; i < repeats; i++) {
+			run(work);
+		}
+		uint64_t elapsed = ticks() - start;
+		if (elapsed < best) best = elapsed;
+	}
+
+	return (double)best / (repeats * bytes);
+}
+
+/** Residues with a newline every `width` bytes. */
+static void fill_words(char *buffer, size_t size, size_t width) {
+	for (size_t i = 0; i < size; i++) {
+		buffer[i] = "ACGT"[i % 4];
+		if (width && i % width == width - 1) buffer[i] = '\n';
+	}
+}
+
+/** Whitespace with a residue every `width` bytes. */
+static void fill_spaces(char *buffer, size_t size, size_t width) {
+	for (size_t i = 0; i < size; i++) {
+		buffer[i] = " \n"[i % 2];
+		if (width && i % width == width - 1) buffer[i] = 'A';
+	}
+}
+
+// Find every word or every gap, as the parser does.
+static void run_find_space(struct work *work) {
+	const char *ptr = work->begin;
+	while (ptr < work->end) {
+		ptr = work->isa->find_space(ptr, work->end) + 1;
+	}
+	work->sink += ptr - work->begin;
+}
+
+static void run_find_not_space(struct work *work) {
+	const char *ptr = work->begin;
+	while (ptr < work->end) {
+		ptr = work->isa->find_not_space(ptr, work->end) + 1;
+	}
+	work->sink += ptr - work->begin;
+}
+
+static void run_count_newlines(struct work *work) {
+	work->sink += work->isa->count(work->begin, work->end);
+}
+
+// Append lines of `width` to a new string, growing it on the way.
+static void run_dynstr_append(struct work *work) {
+	dynstr ds;
+	dynstr_init(&ds, &work->pp);
+	for (const char *ptr = work->begin; ptr < work->end; ptr += work->width) {
+		size_t length = work->width;
+		if (length > (size_t)(work->end - ptr)) length = work->end - ptr;
+		dynstr_append(&ds, ptr, length, &work->pp);
+	}
+	work->sink += ds.count;
+	dynstr_free(&ds);
+}
+
+// Copy all words, stepping over single newlines as pfasta_read_sequence does.
+static void run_copy_word(struct work *work) {
+	struct pfasta_parser *pp = &work->pp;
+	pp->buffer = pp->read_ptr = (char *)work->begin;
+	pp->fill_ptr = (char *)work->end; // reset at the end of the input
+	pp->errstr = NULL;
+	dynstr_reset(&work->target, 0);
+
+	while (copy_word(pp, &work->target, 1) == 0 &&
+	       pp->read_ptr < pp->fill_ptr) {
+		pp->read_ptr++;
+	}
+	work->sink += work->target.count;
+}
+
+static void report(const char *kernel, const char *isa, size_t size,
+                   size_t width, double per_byte) {
+	printf("%s\t%s\t%zu\t", kernel, isa, size);
+	if (width) {
+		printf("%zu", width);
+	} else {
+		printf("-");
+	}
+	printf("\t%.3f\n", per_byte);
+	fflush(stdout);
+}
+
+int main(void) {
+	detect_isas();
+	kernels_select();
+
+	size_t max_size = sizes[num_sizes - 1];
+	char *buffer = malloc(max_size);
+	if (!buffer) err(1, "malloc");
+
+#if PF_DISPATCH
+	printf("# unit: reference cycles per byte\n");
+#else
+	printf("# unit: nanoseconds per byte\n");
+#endif
+	printf("kernel\tisa\tsize\twidth\tper_byte\n");
+
+	struct work work = {0};
+	dynstr_init(&work.target, &work.pp);
+
+	for (size_t s = 0; s < num_sizes; s++) {
+		size_t size = sizes[s];
+		work.begin = buffer;
+		work.end = buffer + size;
+
+		for (size_t w = 0; w < num_widths; w++) {
+			size_t width = widths[w];
+
+			for (size_t i = 0; i < num_isas; i++) {
+				if (!isas[i].supported) continue;
+				work.isa = &isas[i];
+
+				fill_words(buffer, size, width);
+				report("find_first_space", isas[i].name, size, width,
+				       measure(run_find_space, &work, size));
+				report("count_newlines", isas[i].name, size, width,
+				       measure(run_count_newlines, &work, size));
+
+				fill_spaces(buffer, size, width);
+				report("find_first_not_space", isas[i].name, size, width,
+				       measure(run_find_not_space, &work, size));
+
+				// copy_word scans through the selected kernel.
+				if (!width) continue;
+				fill_words(buffer, size, width);
+				work.pp = pfasta_init_mem(">", 1);
+				find_first_space = isas[i].find_space;
+				report("copy_word", isas[i].name, size, width,
+				       measure(run_copy_word, &work, size));
+			}
+
+			// Appending is plain memcpy, but sensitive to growth.
+			if (!width) continue;
+			work.width = width;
+			report("dynstr_append", "-", size, width,
+			       measure(run_dynstr_append, &work, size));
+		}
+	}
+
+	dynstr_free(&work.target);
+	free(buffer);
+	return EXIT_SUCCESS;
+}
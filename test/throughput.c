@@ -0,0 +1,251 @@
+/*
+ * Throughput benchmark: parse each corpus with a plain `pfasta_read` loop and
+ * run each given tool on it. Every measurement happens in a fresh child
+ * process, so that peak memory is attributed correctly. The best time of a
+ * few runs is reported as one tab separated line per corpus and program, to
+ * be compared across commits. Allocations are counted only for the loop
+ * within this process; tools get a dash.
+ */
+
+#include <err.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pfasta.h"
+
+struct result {
+	double seconds;
+	size_t records;
+	size_t allocations;
+	long max_rss; // in kB
+	int counted;  // whether allocations were counted
+};
+
+static size_t allocations = 0;
+
+#ifdef __GLIBC__
+// Count every allocation made by the parser and pass it on to glibc.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+	allocations++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+	allocations++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size) {
+	if (size && nmemb > (size_t)-1 / size) return NULL;
+	return realloc(ptr, nmemb * size);
+}
+
+void free(void *ptr) { __libc_free(ptr); }
+#endif
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Parse a file with `pfasta_read` in a child and report back via a pipe. */
+static struct result run_read(const char *file_name) {
+	struct result res = {0};
+	int fds[2];
+	if (pipe(fds)) err(1, "pipe");
+
+	pid_t pid = fork();
+	if (pid < 0) err(1, "fork");
+	if (pid == 0) {
+		close(fds[0]);
+		int file_descriptor = open(file_name, O_RDONLY);
+		if (file_descriptor < 0) err(1, "%s", file_name);
+
+		double start = now();
+		allocations = 0;
+		struct pfasta_parser pp = pfasta_init(file_descriptor);
+		while (!pp.done) {
+			struct pfasta_record pr = pfasta_read(&pp);
+			if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
+			pfasta_record_free(&pr);
+			res.records++;
+		}
+		pfasta_free(&pp);
+		res.seconds = now() - start;
+		res.allocations = allocations;
+#ifdef __GLIBC__
+		res.counted = 1;
+#endif
+
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		res.max_rss = usage.ru_maxrss;
+
+		if (write(fds[1], &res, sizeof(res)) != sizeof(res)) err(1, "write");
+		_exit(0);
+	}
+
+	close(fds[1]);
+	ssize_t got = read(fds[0], &res, sizeof(res));
+	close(fds[0]);
+
+	int status;
+	waitpid(pid, &status, 0);
+	if (got != sizeof(res) || !WIFEXITED(status) || WEXITSTATUS(status)) {
+		errx(1, "%s: pfasta_read failed", file_name);
+	}
+
+	return res;
+}
+
+/** Run a tool on a file, with its output discarded. */
+static struct result run_tool(const char *tool, const char *file_name) {
+	struct result res = {0};
+
+	double start = now();
+	pid_t pid = fork();
+	if (pid < 0) err(1, "fork");
+	if (pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+		if (null < 0) err(1, "/dev/null");
+		dup2(null, STDOUT_FILENO);
+		execl(tool, tool, file_name, (char *)NULL);
+		err(1, "%s", tool);
+	}
+
+	int status;
+	struct rusage usage;
+	if (wait4(pid, &status, 0, &usage) < 0) err(1, "wait4");
+	res.seconds = now() - start;
+	res.max_rss = usage.ru_maxrss;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		errx(1, "%s %s failed", tool, file_name);
+	}
+
+	return res;
+}
+
+/** Strip the directory and extension off a corpus or tool name. */
+static const char *short_name(const char *path, char *buffer, size_t size) {
+	const char *base = strrchr(path, '/');
+	base = base ? base + 1 : path;
+
+	snprintf(buffer, size, "%s", base);
+	char *dot = strchr(buffer, '.');
+	if (dot) *dot = '\0';
+	return buffer;
+}
+
+static void report(const char *corpus, const char *program, off_t bytes,
+                   size_t records, struct result res) {
+	printf("%s\t%s\t%lld\t%zu\t%.4f\t%.1f\t%.0f\t%ld\t", corpus, program,
+	       (long long)bytes, records, res.seconds, bytes / res.seconds / 1e6,
+	       records / res.seconds, res.max_rss);
+	if (res.counted) {
+		printf("%.2f\n", records ? (double)res.allocations / records : 0.0);
+	} else {
+		printf("-\n");
+	}
+	fflush(stdout);
+}
+
+/** Keep the fastest run, but the largest memory footprint. */
+static void keep_best(struct result *best, struct result res, int first) {
+	if (first || res.seconds < best->seconds) {
+		long max_rss = best->max_rss;
+		*best = res;
+		if (!first && max_rss > best->max_rss) best->max_rss = max_rss;
+	} else if (res.max_rss > best->max_rss) {
+		best->max_rss = res.max_rss;
+	}
+}
+
+static void usage(int exit_code) {
+	static const char str[] = {
+	    "throughput [-r runs] [-t tool]... FILES...\n"
+	    "Measure how fast files are parsed and processed by tools.\n\n"
+	    "Options:\n"
+	    "  -h          Display help and exit\n"
+	    "  -r runs     Keep the best of this many runs (default: 3)\n"
+	    "  -t tool     Also run this tool on every file\n" //
+	};
+
+	fprintf(exit_code == EXIT_SUCCESS ? stdout : stderr, str);
+	exit(exit_code);
+}
+
+int main(int argc, char *argv[]) {
+	const char *tools[argc];
+	size_t num_tools = 0;
+	int runs = 3;
+
+	int c;
+	while ((c = getopt(argc, argv, "hr:t:")) != -1) {
+		switch (c) {
+		case 'r':
+			runs = atoi(optarg);
+			if (runs < 1) errx(1, "invalid number of runs: %s", optarg);
+			break;
+		case 't':
+			tools[num_tools++] = optarg;
+			break;
+		case 'h':
+			usage(EXIT_SUCCESS);
+		default:
+			usage(EXIT_FAILURE);
+		}
+	}
+
+	const char *version = pfasta_version();
+	printf("# pfasta %s\n", *version ? version : "unknown");
+	printf("corpus\tprogram\tbytes\trecords\tseconds\tMB/s\trecords/s\t"
+	       "max_rss_kB\tallocs/record\n");
+
+	for (int i = optind; i < argc; i++) {
+		const char *file_name = argv[i];
+		struct stat st;
+		if (stat(file_name, &st)) err(1, "%s", file_name);
+
+		char corpus[64];
+		short_name(file_name, corpus, sizeof(corpus));
+
+		struct result best = {0};
+		for (int run = 0; run < runs; run++) {
+			keep_best(&best, run_read(file_name), run == 0);
+		}
+		size_t records = best.records;
+		report(corpus, "pfasta_read", st.st_size, records, best);
+
+		for (size_t t = 0; t < num_tools; t++) {
+			for (int run = 0; run < runs; run++) {
+				keep_best(&best, run_tool(tools[t], file_name), run == 0);
+			}
+
+			char program[64];
+			short_name(tools[t], program, sizeof(program));
+			report(corpus, program, st.st_size, records, best);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -10,10 +10,10 @@
 #include "pfasta.h"
 
 static int line_length = 70;
+static struct pfasta_writer *out;
 
 void usage(int exit_code);
 void process(const char *file_name);
-void filter_acgt(char *seq);
 
 int main(int argc, char *argv[]) {
 	int c;
@@ -27,7 +27,6 @@ int main(int argc, char *argv[]) {
 			line_length = my_strtonum(optarg, 0, INT_MAX, &errstr);
 			if (errstr) errx(1, "line length is %s: %s", errstr, optarg);
 
-			if (!line_length) line_length = -1;
 			break;
 		}
 		default:
@@ -35,6 +34,8 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	out = pfasta_stdout_writer(line_length);
+
 	argc -= optind, argv += optind;
 	if (argc == 0) {
 		if (!isatty(STDIN_FILENO)) {
@@ -59,40 +60,39 @@ void process(const char *file_name) {
 	struct pfasta_parser pp = pfasta_init(file_descriptor);
 	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
 
+	// The parser drops everything else while copying.
+	if (pfasta_set_flags(&pp, PFASTA_ACGT)) err(1, "%s", file_name);
+
+	static char chunk[1 << 16];
 	while (!pp.done) {
-		struct pfasta_record pr = pfasta_read(&pp);
+		pfasta_progress(file_name, &pp);
+		struct pfasta_view pv = pfasta_read_header(&pp);
 		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
-		filter_acgt(pr.sequence);
-		pfasta_print(STDOUT_FILENO, &pr, line_length);
-		pfasta_record_free(&pr);
-	}
+		// The header waits for the sequence, so that a record failing right
+		// away leaves nothing behind.
+		size_t count = pfasta_read_chunk(&pp, chunk, sizeof(chunk));
+		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
-	pfasta_free(&pp);
-	close(file_descriptor);
-}
+		if (pfasta_write_header(out, &pv)) {
+			errx(1, "error writing: %s", out->errstr);
+		}
 
-void filter_acgt(char *seq) {
-	char const *p = seq;
-	char *q = seq;
-	for (; *p; p++) {
-		char c = *p;
-		switch (c) {
-		case 'A':
-		case 'C':
-		case 'G':
-		case 'T':
-		case 'a':
-		case 'c':
-		case 'g':
-		case 't':
-			*q++ = c;
-			break;
-		default:
-			break;
+		for (; count; count = pfasta_read_chunk(&pp, chunk, sizeof(chunk))) {
+			if (pfasta_write_chunk(out, chunk, count)) {
+				errx(1, "error writing: %s", out->errstr);
+			}
+		}
+		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
+
+		if (pfasta_write_end(out)) {
+			errx(1, "error writing: %s", out->errstr);
 		}
 	}
-	*q++ = 0;
+
+	pfasta_print_stats(file_name, &pp);
+	pfasta_free(&pp);
+	close(file_descriptor);
 }
 
 void usage(int exit_code) {
@@ -12,31 +12,37 @@
 
 void usage(int exit_code);
 void process(const char *file_name);
-size_t count_muts(const struct pfasta_record *subject,
-                  const struct pfasta_record *query, size_t length);
+size_t count_muts(const struct pfasta_packed *subject,
+                  const struct pfasta_packed *query);
 void print_mutations(size_t *DD);
 void print_jc(size_t *DD, size_t length);
 void print_ani(size_t *DD, size_t length);
 
+/** Sequences are kept packed, with two bits per base. */
+struct packed_record {
+	char *name;
+	struct pfasta_packed sequence;
+};
+
 struct seq_vector {
-	struct pfasta_record *data;
+	struct packed_record *data;
 	size_t size;
 	size_t capacity;
 } sv;
 
 void sv_init() {
-	sv.data = malloc(4 * sizeof(struct pfasta_record));
+	sv.data = malloc(4 * sizeof(struct packed_record));
 	sv.size = 0;
 	sv.capacity = 4;
 	if (!sv.data) err(errno, "malloc failed");
 }
 
-void sv_emplace(struct pfasta_record ps) {
+void sv_emplace(struct packed_record ps) {
 	if (sv.size < sv.capacity) {
 		sv.data[sv.size++] = ps;
 	} else {
 		sv.data = my_reallocarray(sv.data, sv.capacity / 2,
-		                          3 * sizeof(struct pfasta_record));
+		                          3 * sizeof(struct packed_record));
 		if (!sv.data) err(errno, "realloc failed");
 		// reallocarray would return NULL, if mult would overflow
 		sv.capacity = (sv.capacity / 2) * 3;
@@ -46,7 +52,8 @@ void sv_emplace(struct pfasta_record ps) {
 
 void sv_free() {
 	for (size_t i = 0; i < sv.size; i++) {
-		pfasta_record_free(&sv.data[i]);
+		free(sv.data[i].name);
+		pfasta_packed_free(&sv.data[i].sequence);
 	}
 	free(sv.data);
 }
@@ -95,9 +102,9 @@ int main(int argc, char *argv[]) {
 
 	// check lengths
 	if (sv.size < 2) errx(1, "less than two sequences read");
-	size_t length = strlen(sv.data[0].sequence);
+	size_t length = sv.data[0].sequence.length;
 	for (size_t i = 1; i < sv.size; i++) {
-		if (strlen(sv.data[i].sequence) != length) {
+		if (sv.data[i].sequence.length != length) {
 			errx(1, "alignments of unequal length");
 		}
 	}
@@ -110,7 +117,8 @@ int main(int argc, char *argv[]) {
 	for (size_t i = 0; i < sv.size; i++) {
 		D(i, i) = 0.0;
 		for (size_t j = 0; j < i; j++) {
-			D(i, j) = D(j, i) = count_muts(&sv.data[i], &sv.data[j], length);
+			D(i, j) = D(j, i) =
+			    count_muts(&sv.data[i].sequence, &sv.data[j].sequence);
 		}
 	}
 
@@ -137,29 +145,28 @@ void process(const char *file_name) {
 	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
 
 	while (!pp.done) {
-		struct pfasta_record pr = pfasta_read(&pp);
+		pfasta_progress(file_name, &pp);
+		struct pfasta_view pv = pfasta_read_header(&pp);
+		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
+
+		struct packed_record ps = {0};
+		ps.name = strndup(pv.name.data, pv.name.length);
+		if (!ps.name) err(errno, "strndup failed");
+
+		pfasta_read_packed(&pp, &ps.sequence);
 		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
-		sv_emplace(pr);
+		sv_emplace(ps);
 	}
 
+	pfasta_print_stats(file_name, &pp);
 	pfasta_free(&pp);
 	close(file_descriptor);
 }
 
-size_t count_muts(const struct pfasta_record *subject,
-                  const struct pfasta_record *query, size_t length) {
-	size_t mutations = 0;
-	const char *s = subject->sequence;
-	const char *q = query->sequence;
-
-	for (size_t i = 0; i < length; i++) {
-		if (s[i] != q[i]) {
-			mutations++;
-		}
-	}
-
-	return mutations;
+size_t count_muts(const struct pfasta_packed *subject,
+                  const struct pfasta_packed *query) {
+	return pfasta_packed_mismatches(subject, query);
 }
 
 void print_mutations(size_t *DD) {
@@ -20,12 +20,16 @@ struct seq_vector {
 	struct pfasta_record *data;
 	size_t size;
 	size_t capacity;
+	struct pfasta_batch *batches;
+	size_t num_batches;
 } sv;
 
 void sv_init() {
 	sv.data = malloc(4 * sizeof(struct pfasta_record));
 	sv.size = 0;
 	sv.capacity = 4;
+	sv.batches = NULL;
+	sv.num_batches = 0;
 	if (!sv.data) err(errno, "malloc failed");
 }
 
@@ -42,10 +46,23 @@ void sv_emplace(struct pfasta_record pr) {
 	}
 }
 
+/** The batch keeps the strings; the vector only refers to them. */
+void sv_emplace_batch(struct pfasta_batch pb) {
+	for (size_t i = 0; i < pb.count; i++) {
+		sv_emplace(pb.records[i]);
+	}
+
+	sv.batches =
+	    my_reallocarray(sv.batches, sv.num_batches + 1, sizeof(*sv.batches));
+	if (!sv.batches) err(errno, "realloc failed");
+	sv.batches[sv.num_batches++] = pb;
+}
+
 void sv_free() {
-	for (size_t i = 0; i < sv.size; i++) {
-		pfasta_record_free(&sv.data[i]);
+	for (size_t i = 0; i < sv.num_batches; i++) {
+		pfasta_batch_free(&sv.batches[i]);
 	}
+	free(sv.batches);
 	free(sv.data);
 }
 
@@ -65,7 +82,6 @@ int main(int argc, char *argv[]) {
 			line_length = my_strtonum(optarg, 0, INT_MAX, &errstr);
 			if (errstr) errx(1, "line length is %s: %s", errstr, optarg);
 
-			if (!line_length) line_length = -1;
 			break;
 		}
 		case 's': {
@@ -138,6 +154,7 @@ int main(int argc, char *argv[]) {
 		snprintf(buf, sizeof(buf), "replicate-%u.fa", b);
 		int fd = open(buf, O_WRONLY | O_CREAT,
 		              S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		struct pfasta_writer pw = pfasta_writer_init(fd, line_length);
 
 		for (size_t i = 0; i < sv.size; i++) {
 			memcpy(&pr, &sv.data[i], sizeof(pr));
@@ -147,9 +164,11 @@ int main(int argc, char *argv[]) {
 			}
 
 			pr.sequence = tempseq;
-			pfasta_print(fd, &pr, line_length);
+			if (pfasta_write(&pw, &pr)) errx(1, "%s: %s", buf, pw.errstr);
 		}
 
+		if (pfasta_writer_flush(&pw)) errx(1, "%s: %s", buf, pw.errstr);
+		pfasta_writer_free(&pw);
 		close(fd);
 	}
 
@@ -169,12 +188,14 @@ void process(const char *file_name) {
 	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
 
 	while (!pp.done) {
-		struct pfasta_record pr = pfasta_read(&pp);
+		pfasta_progress(file_name, &pp);
+		struct pfasta_batch pb = pfasta_read_batch(&pp, 0, 0);
 		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
-		sv_emplace(pr);
+		sv_emplace_batch(pb);
 	}
 
+	pfasta_print_stats(file_name, &pp);
 	pfasta_free(&pp);
 	close(file_descriptor);
 }
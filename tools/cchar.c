@@ -1,4 +1,3 @@
-#include <ctype.h>
 #include <err.h>
 #include <fcntl.h>
 #include <getopt.h>
@@ -7,12 +6,13 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "common.h"
 #include "pfasta.h"
 
-void count(const struct pfasta_record *);
-void print_counts(const char *name, const size_t *counts);
+void count(struct pfasta_span sequence);
+void print_counts(const char *name, size_t name_length, const size_t *counts);
 void usage(int exit_code);
-void process(const char *file_name);
+void process(const char *file_name, struct pfasta_queue *queue);
 
 // const int CHARS = 128;
 #define CHARS 128
@@ -40,72 +40,73 @@ int main(int argc, char *argv[]) {
 
 	argc -= optind, argv += optind;
 	if (argc == 0) {
-		if (!isatty(STDIN_FILENO)) {
-			process("-");
-		} else {
-			usage(EXIT_FAILURE);
-		}
+		if (isatty(STDIN_FILENO)) usage(EXIT_FAILURE);
+
+		static char *standard_input[] = {"-"};
+		argc = 1, argv = standard_input;
 	}
 
+	// Many small files are opened and read ahead.
+	struct pfasta_queue queue = pfasta_queue_init(argv, argc);
+	if (queue.errstr) errx(1, "%s", queue.errstr);
+
 	for (int i = 0; i < argc; i++) {
-		process(argv[i]);
+		process(argv[i], &queue);
 	}
 
+	pfasta_queue_free(&queue);
 	return EXIT_SUCCESS;
 }
 
-void process(const char *file_name) {
+void process(const char *file_name, struct pfasta_queue *queue) {
 	bzero(counts_total, sizeof(counts_total));
 
-	int file_descriptor =
-	    strcmp(file_name, "-") == 0 ? STDIN_FILENO : open(file_name, O_RDONLY);
-	if (file_descriptor < 0) err(1, "%s", file_name);
-
-	struct pfasta_parser pp = pfasta_init(file_descriptor);
+	struct pfasta_parser pp = pfasta_queue_next(queue);
 	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
 
+	// Let the parser fold the case while copying.
+	if ((FLAGS & CASE_INSENSITIVE) && pfasta_set_flags(&pp, PFASTA_UPPERCASE)) {
+		err(1, "%s", file_name);
+	}
+
 	while (!pp.done) {
-		struct pfasta_record pr = pfasta_read(&pp);
+		pfasta_progress(file_name, &pp);
+		struct pfasta_view pv = pfasta_read_view(&pp);
 		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
-		count(&pr);
+		count(pv.sequence);
 		if (FLAGS & SPLIT) {
-			print_counts(pr.name, counts_local);
+			print_counts(pv.name.data, pv.name.length, counts_local);
 			bzero(counts_local, sizeof(counts_local));
 		}
-		pfasta_record_free(&pr);
 		for (size_t i = 0; i < CHARS; i++) {
 			counts_total[i] += counts_local[i];
 		}
 	}
 
 	if (!(FLAGS & SPLIT)) {
-		print_counts(file_name, counts_total);
+		print_counts(file_name, strlen(file_name), counts_total);
 		bzero(counts_total, sizeof(counts_total));
 	}
 
+	pfasta_print_stats(file_name, &pp);
 	pfasta_free(&pp);
-	close(file_descriptor);
 }
 
-void count(const struct pfasta_record *pr) {
+void count(struct pfasta_span sequence) {
 	bzero(counts_local, sizeof(counts_local));
-	const char *ptr = pr->sequence;
+	const char *ptr = sequence.data;
 
-	while (*ptr) {
-		unsigned char c = *ptr;
-		if (FLAGS & CASE_INSENSITIVE) {
-			c = toupper(c);
-		}
+	for (size_t i = 0; i < sequence.length; i++) {
+		unsigned char c = ptr[i];
 		if (c < CHARS) {
 			counts_local[c]++;
 		}
-		ptr++;
 	}
 }
 
-void print_counts(const char *name, const size_t *counts) {
-	printf(">%s\n", name);
+void print_counts(const char *name, size_t name_length, const size_t *counts) {
+	printf(">%.*s\n", (int)name_length, name);
 
 	size_t sum = 0;
 	for (int i = 1; i < CHARS; ++i) {
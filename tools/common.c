@@ -1,39 +1,89 @@
+#include <err.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "common.h"
 #include "pfasta.h"
 
-int pfasta_print(int file_descriptor, const struct pfasta_record *pr,
-                 int line_length) {
-	if (file_descriptor < 0 || !pr) {
-		errno = EINVAL;
-		return -EINVAL;
-	}
+// Tracepoints next to those of the library, see there.
+#ifdef WITH_SDT
+#include <sys/sdt.h>
+#define TOOL_PROBE2(NAME, A, B) DTRACE_PROBE2(pfasta, NAME, A, B)
+#else
+#define TOOL_PROBE2(NAME, A, B) ((void)0)
+#endif
 
-	int check;
-	if (pr->comment) {
-		check = dprintf(file_descriptor, ">%s %s\n", pr->name, pr->comment);
-	} else {
-		check = dprintf(file_descriptor, ">%s\n", pr->name);
-	}
+static struct pfasta_writer stdout_writer;
 
-	if (check < 0) {
-		return check;
+/** Write out what is left at exit, even when a tool bails out on an error. */
+static void stdout_flush(void) {
+	if (pfasta_writer_flush(&stdout_writer)) {
+		warnx("error writing: %s", stdout_writer.errstr);
+		_exit(1);
 	}
+	pfasta_writer_free(&stdout_writer);
+}
 
-	const char *seq = pr->sequence;
+struct pfasta_writer *pfasta_stdout_writer(int line_length) {
+	stdout_writer = pfasta_writer_init(STDOUT_FILENO, line_length);
+	if (stdout_writer.errstr) errx(1, "%s", stdout_writer.errstr);
 
-	for (ssize_t j; *seq; seq += j) {
-		j = dprintf(file_descriptor, "%.*s\n", line_length, seq) - 1;
-		if (j < 0) {
-			return j;
-		}
+	if (atexit(stdout_flush)) errx(1, "atexit failed");
+	return &stdout_writer;
+}
+
+#define PROGRESS_INTERVAL UINT64_C(1000000000) // in nanoseconds
+
+static uint64_t progress_next = PROGRESS_INTERVAL;
+
+/** The dispatcher passes its -V flag on via the environment. */
+static int verbose(void) {
+	static int cached = -1;
+	if (cached < 0) {
+		const char *value = getenv("PFASTA_VERBOSE");
+		cached = value && *value && strcmp(value, "0") != 0;
 	}
+	return cached;
+}
+
+static double megabytes_per_second(size_t bytes, uint64_t nanoseconds) {
+	return nanoseconds ? bytes * 1e3 / nanoseconds : 0.0;
+}
+
+// Tools call this before every record of a file, …
+void pfasta_progress(const char *file_name, const struct pfasta_parser *pp) {
+	TOOL_PROBE2(tool_record, file_name, pp);
+	if (!verbose()) return;
+
+	struct pfasta_stats stats = pfasta_get_stats(pp);
+	if (stats.elapsed_nanoseconds < progress_next) return;
+
+	warnx("%s: %.1f MB, %.1f MB/s", file_name, stats.bytes / 1e6,
+	      megabytes_per_second(stats.bytes, stats.elapsed_nanoseconds));
+	progress_next = stats.elapsed_nanoseconds + PROGRESS_INTERVAL;
+}
+
+// … and this once they are done with it.
+void pfasta_print_stats(const char *file_name, const struct pfasta_parser *pp) {
+	TOOL_PROBE2(tool_file_end, file_name, pp);
+	progress_next = PROGRESS_INTERVAL; // start over with the next file
+	if (!verbose()) return;
 
-	return 0;
+	struct pfasta_stats stats = pfasta_get_stats(pp);
+	warnx("%s: %zu records, %zu lines, %zu bytes", file_name, stats.records,
+	      stats.lines, stats.bytes);
+	warnx("%s: %zu reads of %.0f bytes on average, %zu within a record",
+	      file_name, stats.reads,
+	      stats.reads ? (double)stats.bytes_read / stats.reads : 0.0,
+	      stats.mid_record_refills);
+	warnx("%s: %zu reallocations, %zu bytes copied", file_name,
+	      stats.reallocs, stats.bytes_copied);
+	warnx("%s: %.3f s, %.3f s of it waiting for input, %.1f MB/s", file_name,
+	      stats.elapsed_nanoseconds / 1e9, stats.io_nanoseconds / 1e9,
+	      megabytes_per_second(stats.bytes, stats.elapsed_nanoseconds));
 }
 
 extern __attribute__((weak)) // may be supplied by libc
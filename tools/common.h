@@ -1,8 +1,9 @@
 #pragma once
 #include <pfasta.h>
 
-int pfasta_print(int file_descriptor, const struct pfasta_record *pr,
-                 int line_length);
+struct pfasta_writer *pfasta_stdout_writer(int line_length);
+void pfasta_progress(const char *file_name, const struct pfasta_parser *pp);
+void pfasta_print_stats(const char *file_name, const struct pfasta_parser *pp);
 long long my_strtonum(const char *numstr, long long minval, long long maxval,
                       const char **errstrp);
 void *my_reallocarray(void *ptr, size_t nmemb, size_t size);
@@ -12,6 +12,7 @@
 #include "pfasta.h"
 
 static int line_length = 70;
+static struct pfasta_writer *out;
 
 void usage(int exit_code);
 void process(const char *file_name);
@@ -29,7 +30,6 @@ int main(int argc, char *argv[]) {
 			line_length = my_strtonum(optarg, 0, INT_MAX, &errstr);
 			if (errstr) errx(1, "line length is %s: %s", errstr, optarg);
 
-			if (!line_length) line_length = -1;
 			break;
 		}
 		default:
@@ -37,6 +37,8 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	out = pfasta_stdout_writer(line_length);
+
 	argc -= optind, argv += optind;
 	if (argc == 0) {
 		if (!isatty(STDIN_FILENO)) {
@@ -73,24 +75,35 @@ void process(const char *file_name) {
 		file_name_dot = strchr(file_name_sep, '\0');
 	}
 
-	printf(">%.*s\n", (int)(file_name_dot - file_name_sep), file_name_sep);
+	struct pfasta_view pv = {
+	    .name = {file_name_sep, file_name_dot - file_name_sep},
+	};
+	if (pfasta_write_header(out, &pv)) {
+		errx(1, "error writing: %s", out->errstr);
+	}
 
 	// concat sequences
+	static char chunk[1 << 16];
 	while (!pp.done) {
-		struct pfasta_record pr = pfasta_read(&pp);
+		pfasta_progress(file_name, &pp);
+		pfasta_read_header(&pp);
 		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
-		const char *seq = pr.sequence;
+
 		// print sequence only
-		for (ssize_t j; *seq; seq += j) {
-			j = printf("%.*s\n", line_length, seq) - 1;
-			if (j < 0) {
-				err(errno, "error printing");
+		size_t count;
+		while ((count = pfasta_read_chunk(&pp, chunk, sizeof(chunk)))) {
+			if (pfasta_write_chunk(out, chunk, count)) {
+				errx(1, "error writing: %s", out->errstr);
 			}
 		}
+		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
-		pfasta_record_free(&pr);
+		if (pfasta_write_end(out)) {
+			errx(1, "error writing: %s", out->errstr);
+		}
 	}
 
+	pfasta_print_stats(file_name, &pp);
 	pfasta_free(&pp);
 	close(file_descriptor);
 }
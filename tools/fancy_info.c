@@ -9,6 +9,7 @@
 #include <unistd.h>
 #include <wchar.h>
 
+#include "common.h"
 #include "pfasta.h"
 
 #define BOLD "\033[1m"
@@ -76,6 +77,7 @@ void process(const char *file_name) {
 	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
 
 	while (!pp.done) {
+		pfasta_progress(file_name, &pp);
 		struct pfasta_record pr = pfasta_read(&pp);
 		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
@@ -95,6 +97,7 @@ void process(const char *file_name) {
 		bzero(counts_total, sizeof(counts_total));
 	}
 
+	pfasta_print_stats(file_name, &pp);
 	pfasta_free(&pp);
 	close(file_descriptor);
 }
@@ -0,0 +1,162 @@
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "pfasta.h"
+
+static int line_length = 70;
+static struct pfasta_writer *out;
+
+_Noreturn void usage(int exit_code);
+void fetch(struct pfasta_index *index, const char *region);
+int parse_range(const char *str, size_t *start, size_t *end);
+void load_gzi(struct pfasta_index *index, const char *file_name);
+
+int main(int argc, char *argv[]) {
+	int c;
+	while ((c = getopt(argc, argv, "hL:")) != -1) {
+		switch (c) {
+		case 'h':
+			usage(EXIT_SUCCESS);
+		case 'L': {
+			const char *errstr;
+
+			line_length = my_strtonum(optarg, 0, INT_MAX, &errstr);
+			if (errstr) errx(1, "line length is %s: %s", errstr, optarg);
+
+			break;
+		}
+		default:
+			usage(EXIT_FAILURE);
+		}
+	}
+
+	out = pfasta_stdout_writer(line_length);
+
+	argc -= optind, argv += optind;
+	if (argc < 2) usage(EXIT_FAILURE);
+
+	const char *file_name = argv[0];
+	int file_descriptor = open(file_name, O_RDONLY);
+	if (file_descriptor < 0) err(1, "%s", file_name);
+
+	char *index_name;
+	if (asprintf(&index_name, "%s.fai", file_name) < 0) {
+		err(errno, "asprintf");
+	}
+
+	// Without an index on disk, build one on the fly.
+	struct pfasta_index index;
+	int index_descriptor = open(index_name, O_RDONLY);
+	if (index_descriptor >= 0) {
+		index = pfasta_index_load(file_descriptor, index_descriptor);
+		if (index.errstr) errx(1, "%s: %s", index_name, index.errstr);
+		close(index_descriptor);
+
+		if (index.compressed) load_gzi(&index, file_name);
+	} else {
+		index = pfasta_index_build(file_descriptor);
+		if (index.errstr) errx(1, "%s: %s", file_name, index.errstr);
+	}
+
+	for (int i = 1; i < argc; i++) {
+		fetch(&index, argv[i]);
+	}
+
+	free(index_name);
+	pfasta_index_free(&index);
+	close(file_descriptor);
+
+	return EXIT_SUCCESS;
+}
+
+/** A compressed file also needs its block offsets from FILE.gzi. */
+void load_gzi(struct pfasta_index *index, const char *file_name) {
+	char *gzi_name;
+	if (asprintf(&gzi_name, "%s.gzi", file_name) < 0) {
+		err(errno, "asprintf");
+	}
+
+	int gzi_descriptor = open(gzi_name, O_RDONLY);
+	if (gzi_descriptor < 0) err(1, "%s", gzi_name);
+
+	if (pfasta_index_load_gzi(index, gzi_descriptor)) {
+		errx(1, "%s: %s", gzi_name, index->errstr);
+	}
+
+	close(gzi_descriptor);
+	free(gzi_name);
+}
+
+/** Parse "start-end" or "start" with one-based, inclusive positions. */
+int parse_range(const char *str, size_t *start, size_t *end) {
+	char *ptr;
+
+	errno = 0;
+	unsigned long long first = strtoull(str, &ptr, 10);
+	if (errno || ptr == str || *str == '-' || first == 0) return -1;
+
+	unsigned long long last = SIZE_MAX;
+	if (*ptr == '-') {
+		const char *rest = ptr + 1;
+		last = strtoull(rest, &ptr, 10);
+		if (errno || ptr == rest || *rest == '-' || last < first) return -1;
+	}
+	if (*ptr != '\0') return -1;
+
+	*start = first - 1;
+	*end = last;
+	return 0;
+}
+
+void fetch(struct pfasta_index *index, const char *region) {
+	char *name = strdup(region);
+	if (!name) err(errno, "strdup");
+
+	// A region is either just a name or NAME:START[-END].
+	size_t start = 0, end = SIZE_MAX;
+	char *colon = strrchr(name, ':');
+	int ranged = colon && parse_range(colon + 1, &start, &end) == 0;
+	if (ranged) *colon = '\0';
+
+	char *sequence = pfasta_fetch(index, name, start, end);
+	if (!sequence) errx(2, "%s: %s", region, index->errstr);
+
+	// A range covers at least one base, so nothing means past the end.
+	if (ranged && !*sequence) {
+		errx(2, "%s: Range starts past the end of the sequence", region);
+	}
+
+	struct pfasta_record pr = {0};
+	pr.name = (char *)region;
+	pr.name_length = strlen(region);
+	pr.sequence = sequence;
+	pr.sequence_length = strlen(sequence);
+	if (pfasta_write(out, &pr)) errx(1, "writing failed: %s", out->errstr);
+
+	free(sequence);
+	free(name);
+}
+
+void usage(int exit_code) {
+	static const char str[] = {
+	    "Usage: fetch [OPTIONS...] FILE REGION...\n"
+	    "Print regions of the sequences in FILE using its index FILE.fai\n"
+	    "(and FILE.gzi, if FILE is BGZF-compressed).\n"
+	    "A region is NAME, NAME:START or NAME:START-END with one-based,\n"
+	    "inclusive positions.\n\n"
+	    "Options:\n"
+	    "  -h         Display help and exit\n"
+	    "  -L num     Set the maximum line length (0 to disable)\n" //
+	};
+
+	fprintf(exit_code == EXIT_SUCCESS ? stdout : stderr, str);
+	exit(exit_code);
+}
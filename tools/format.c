@@ -13,6 +13,7 @@ void process(const char *file_name);
 void usage(int exit_code);
 
 static size_t line_length = 70;
+static struct pfasta_writer *out;
 
 int main(int argc, char *argv[]) {
 	int c;
@@ -26,7 +27,6 @@ int main(int argc, char *argv[]) {
 			line_length = my_strtonum(optarg, 0, INT_MAX, &errstr);
 			if (errstr) errx(1, "line length is %s: %s", errstr, optarg);
 
-			if (!line_length) line_length = -1;
 			break;
 		}
 		default:
@@ -34,6 +34,8 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	out = pfasta_stdout_writer(line_length);
+
 	argc -= optind, argv += optind;
 	if (argc == 0) {
 		if (!isatty(STDIN_FILENO)) {
@@ -58,14 +60,36 @@ void process(const char *file_name) {
 	struct pfasta_parser pp = pfasta_init(file_descriptor);
 	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
 
+	// Sequences are passed through in chunks, so that even chromosomes take
+	// no more memory than this.
+	static char chunk[1 << 16];
 	while (!pp.done) {
-		struct pfasta_record pr = pfasta_read(&pp);
+		pfasta_progress(file_name, &pp);
+		struct pfasta_view pv = pfasta_read_header(&pp);
+		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
+
+		// The header waits for the sequence, so that a record failing right
+		// away leaves nothing behind.
+		size_t count = pfasta_read_chunk(&pp, chunk, sizeof(chunk));
 		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
-		pfasta_print(STDOUT_FILENO, &pr, line_length);
-		pfasta_record_free(&pr);
+		if (pfasta_write_header(out, &pv)) {
+			errx(1, "error writing: %s", out->errstr);
+		}
+
+		for (; count; count = pfasta_read_chunk(&pp, chunk, sizeof(chunk))) {
+			if (pfasta_write_chunk(out, chunk, count)) {
+				errx(1, "error writing: %s", out->errstr);
+			}
+		}
+		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
+
+		if (pfasta_write_end(out)) {
+			errx(1, "error writing: %s", out->errstr);
+		}
 	}
 
+	pfasta_print_stats(file_name, &pp);
 	pfasta_free(&pp);
 	close(file_descriptor);
 }
@@ -5,10 +5,11 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "common.h"
 #include "pfasta.h"
 
-double gc(const struct pfasta_record *pr);
-void process(const char *file_name);
+size_t count_gc(const char *ptr, size_t length);
+void process(const char *file_name, struct pfasta_queue *queue);
 void usage(int exit_code);
 
 int main(int argc, char *argv[]) {
@@ -19,52 +20,60 @@ int main(int argc, char *argv[]) {
 
 	argc -= optind, argv += optind;
 	if (argc == 0) {
-		if (!isatty(STDIN_FILENO)) {
-			process("-");
-		} else {
-			usage(EXIT_FAILURE);
-		}
+		if (isatty(STDIN_FILENO)) usage(EXIT_FAILURE);
+
+		static char *standard_input[] = {"-"};
+		argc = 1, argv = standard_input;
 	}
 
+	// Many small files are opened and read ahead.
+	struct pfasta_queue queue = pfasta_queue_init(argv, argc);
+	if (queue.errstr) errx(1, "%s", queue.errstr);
+
 	for (int i = 0; i < argc; i++) {
-		process(argv[i]);
+		process(argv[i], &queue);
 	}
 
+	pfasta_queue_free(&queue);
 	return EXIT_SUCCESS;
 }
 
-void process(const char *file_name) {
-	int file_descriptor =
-	    strcmp(file_name, "-") == 0 ? STDIN_FILENO : open(file_name, O_RDONLY);
-	if (file_descriptor < 0) err(1, "%s", file_name);
-
-	struct pfasta_parser pp = pfasta_init(file_descriptor);
+void process(const char *file_name, struct pfasta_queue *queue) {
+	struct pfasta_parser pp = pfasta_queue_next(queue);
 	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
 
+	static char chunk[1 << 16];
 	while (!pp.done) {
-		struct pfasta_record pr = pfasta_read(&pp);
+		pfasta_progress(file_name, &pp);
+		struct pfasta_view pv = pfasta_read_header(&pp);
+		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
+
+		size_t gc = 0, length = 0, count;
+		while ((count = pfasta_read_chunk(&pp, chunk, sizeof(chunk)))) {
+			gc += count_gc(chunk, count);
+			length += count;
+		}
 		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
-		printf("%s\t%lf\n", pr.name, gc(&pr));
-		pfasta_record_free(&pr);
+		printf("%.*s\t%lf\n", (int)pv.name.length, pv.name.data,
+		       (double)gc / length);
 	}
 
+	pfasta_print_stats(file_name, &pp);
 	pfasta_free(&pp);
-	close(file_descriptor);
 }
 
-// calculate the GC content
-double gc(const struct pfasta_record *pr) {
+// count the Gs and Cs
+size_t count_gc(const char *ptr, size_t length) {
 	size_t gc = 0;
-	const char *ptr = pr->sequence;
 
-	for (; *ptr; ptr++) {
-		if (*ptr == 'g' || *ptr == 'G' || *ptr == 'c' || *ptr == 'C') {
+	for (size_t i = 0; i < length; i++) {
+		if (ptr[i] == 'g' || ptr[i] == 'G' || ptr[i] == 'c' || ptr[i] == 'C') {
 			gc++;
 		}
 	}
 
-	return (double)gc / (ptr - pr->sequence);
+	return gc;
 }
 
 void usage(int exit_code) {
@@ -0,0 +1,91 @@
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pfasta.h"
+
+void usage(int exit_code);
+void process(const char *file_name);
+void write_gzi(struct pfasta_index *index, const char *file_name);
+
+int main(int argc, char *argv[]) {
+	int c;
+	while ((c = getopt(argc, argv, "h")) != -1) {
+		usage(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	argc -= optind, argv += optind;
+	if (argc == 0) usage(EXIT_FAILURE);
+
+	for (int i = 0; i < argc; i++) {
+		process(argv[i]);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+void process(const char *file_name) {
+	int file_descriptor = open(file_name, O_RDONLY);
+	if (file_descriptor < 0) err(1, "%s", file_name);
+
+	struct pfasta_index index = pfasta_index_build(file_descriptor);
+	if (index.errstr) errx(2, "%s: %s", file_name, index.errstr);
+
+	char *index_name;
+	if (asprintf(&index_name, "%s.fai", file_name) < 0) {
+		err(errno, "asprintf");
+	}
+
+	int index_descriptor =
+	    open(index_name, O_WRONLY | O_CREAT | O_TRUNC,
+	         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (index_descriptor < 0) err(1, "%s", index_name);
+
+	if (pfasta_index_write(&index, index_descriptor)) {
+		errx(1, "%s: %s", index_name, index.errstr);
+	}
+
+	if (close(index_descriptor)) err(1, "%s", index_name);
+	free(index_name);
+
+	if (index.compressed) write_gzi(&index, file_name);
+
+	pfasta_index_free(&index);
+	close(file_descriptor);
+}
+
+void write_gzi(struct pfasta_index *index, const char *file_name) {
+	char *gzi_name;
+	if (asprintf(&gzi_name, "%s.gzi", file_name) < 0) {
+		err(errno, "asprintf");
+	}
+
+	int gzi_descriptor = open(gzi_name, O_WRONLY | O_CREAT | O_TRUNC,
+	                          S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (gzi_descriptor < 0) err(1, "%s", gzi_name);
+
+	if (pfasta_index_write_gzi(index, gzi_descriptor)) {
+		errx(1, "%s: %s", gzi_name, index->errstr);
+	}
+
+	if (close(gzi_descriptor)) err(1, "%s", gzi_name);
+	free(gzi_name);
+}
+
+void usage(int exit_code) {
+	static const char str[] = {
+	    "Usage: index [FILE...]\n"
+	    "Write a samtools-compatible index of each FILE to FILE.fai.\n"
+	    "For BGZF-compressed files the blocks are listed in FILE.gzi.\n\n"
+	    "Options:\n"
+	    "  -h         Display help and exit\n" //
+	};
+
+	fprintf(exit_code == EXIT_SUCCESS ? stdout : stderr, str);
+	exit(exit_code);
+}
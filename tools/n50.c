@@ -12,7 +12,7 @@
 #include "pfasta.h"
 
 void usage(int exit_code);
-void process(const char *file_name);
+void process(const char *file_name, struct pfasta_queue *queue);
 
 int main(int argc, char *argv[]) {
 	int c = getopt(argc, argv, "h");
@@ -24,17 +24,21 @@ int main(int argc, char *argv[]) {
 
 	argc -= optind, argv += optind;
 	if (argc == 0) {
-		if (!isatty(STDIN_FILENO)) {
-			process("-");
-		} else {
-			usage(EXIT_FAILURE);
-		}
+		if (isatty(STDIN_FILENO)) usage(EXIT_FAILURE);
+
+		static char *standard_input[] = {"-"};
+		argc = 1, argv = standard_input;
 	}
 
+	// Many small files are opened and read ahead.
+	struct pfasta_queue queue = pfasta_queue_init(argv, argc);
+	if (queue.errstr) errx(1, "%s", queue.errstr);
+
 	for (int i = 0; i < argc; i++) {
-		process(argv[i]);
+		process(argv[i], &queue);
 	}
 
+	pfasta_queue_free(&queue);
 	return EXIT_SUCCESS;
 }
 
@@ -45,20 +49,21 @@ int size_t_cmp(const void *pa, const void *pb) {
 	return *a < *b ? -1 : 1;
 }
 
-void process(const char *file_name) {
-	int file_descriptor =
-	    strcmp(file_name, "-") == 0 ? STDIN_FILENO : open(file_name, O_RDONLY);
-	if (file_descriptor < 0) err(1, "%s", file_name);
-
+void process(const char *file_name, struct pfasta_queue *queue) {
 	size_t *array = my_reallocarray(NULL, 61, sizeof(*array));
 	size_t capacity = 61;
 	size_t used = 0;
 
-	struct pfasta_parser pp = pfasta_init(file_descriptor);
+	struct pfasta_parser pp = pfasta_queue_next(queue);
 	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
 
 	while (!pp.done) {
-		struct pfasta_record pr = pfasta_read(&pp);
+		pfasta_progress(file_name, &pp);
+		pfasta_read_header(&pp);
+		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
+
+		// Only the length is needed; the sequence is not copied.
+		size_t length = pfasta_skip_sequence(&pp);
 		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
 		if (used >= capacity) {
@@ -69,8 +74,7 @@ void process(const char *file_name) {
 			capacity = (capacity / 2) * 3;
 		}
 
-		array[used++] = pr.sequence_length;
-		pfasta_record_free(&pr);
+		array[used++] = length;
 	}
 
 	qsort(array, used, sizeof(*array), size_t_cmp);
@@ -90,8 +94,8 @@ void process(const char *file_name) {
 	printf("%zu\n", array[i - 1]);
 
 	free(array);
+	pfasta_print_stats(file_name, &pp);
 	pfasta_free(&pp);
-	close(file_descriptor);
 }
 
 void usage(int exit_code) {
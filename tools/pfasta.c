@@ -30,8 +30,10 @@ static const struct description descriptions[] = {
     {"cchar", "Count the residues."},
     {"concat", "Concatenate multiple Fasta files into one sequence."},
     {"fancy_info", "Print a fancy report."},
+    {"fetch", "Print regions of an indexed file."},
     {"format", "Format the input sequence."},
     {"gc_content", "Compute the GC content of each sequence."},
+    {"index", "Index a file for random access."},
     {"n50", "Compute the N50."},
     {"revcomp", "Print the reverse complement of each sequence."},
     {"shuffle", "Shuffle a set of sequences."},
@@ -95,6 +97,9 @@ int main(int argc, char *const *argv) {
 	}
 #endif
 
+	// Let the tool print statistics and progress.
+	if (FLAGS & F_VERBOSE) setenv("PFASTA_VERBOSE", "1", 1);
+
 	int check = execv(path, argv);
 	if (check == -1) err(errno, "%s: executing failed", tool);
 
@@ -11,8 +11,11 @@
 #include "pfasta.h"
 
 static int line_length = 70;
+static struct pfasta_writer *out;
 
-char *revcomp(const char *seq, size_t len);
+void complement_table(unsigned char *table);
+void reverse(char *seq, size_t len);
+void reserve(char **str, size_t *capacity, size_t required);
 void usage(int exit_code);
 void process(const char *file_name);
 
@@ -28,7 +31,6 @@ int main(int argc, char *argv[]) {
 			line_length = my_strtonum(optarg, 0, INT_MAX, &errstr);
 			if (errstr) errx(1, "line length is %s: %s", errstr, optarg);
 
-			if (!line_length) line_length = -1;
 			break;
 		}
 		default:
@@ -36,6 +38,8 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	out = pfasta_stdout_writer(line_length);
+
 	argc -= optind, argv += optind;
 	if (argc == 0) {
 		if (!isatty(STDIN_FILENO)) {
@@ -60,54 +64,84 @@ void process(const char *file_name) {
 	struct pfasta_parser pp = pfasta_init(file_descriptor);
 	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
 
+	// The parser complements while copying; only reversing is left.
+	static unsigned char table[256];
+	if (!table['A']) complement_table(table);
+	if (pfasta_set_table(&pp, table)) err(1, "%s", file_name);
+
+	// Both records are reused for all sequences.
+	struct pfasta_record pr = {0};
+	struct pfasta_record rc = {0};
+	static const char suffix[] = "revcomp";
+
 	while (!pp.done) {
-		struct pfasta_record pr = pfasta_read(&pp);
+		pfasta_progress(file_name, &pp);
+		pfasta_read_into(&pp, &pr);
 		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
-		struct pfasta_record rc;
-		size_t len = pr.sequence_length;
-
-		rc.name = strdup(pr.name);
-		if (!rc.name) err(errno, "out of memory");
-		rc.comment = NULL;
-		rc.sequence = revcomp(pr.sequence, len);
+		reverse(pr.sequence, pr.sequence_length);
 
 		if (pr.comment) {
-			int check = asprintf(&rc.comment, "%s revcomp", pr.comment);
-			if (check < 0) err(errno, "out of memory");
+			// "comment revcomp"
+			reserve(&rc.comment, &rc.comment_capacity,
+			        pr.comment_length + sizeof(suffix) + 1);
+			memcpy(rc.comment, pr.comment, pr.comment_length);
+			rc.comment[pr.comment_length] = ' ';
+			memcpy(rc.comment + pr.comment_length + 1, suffix, sizeof(suffix));
+			rc.comment_length = pr.comment_length + sizeof(suffix);
 		} else {
-			rc.comment = strdup("revcomp");
-			if (!rc.comment) err(errno, "out of memory");
+			reserve(&rc.comment, &rc.comment_capacity, sizeof(suffix));
+			memcpy(rc.comment, suffix, sizeof(suffix));
+			rc.comment_length = sizeof(suffix) - 1;
 		}
 
-		pfasta_print(STDOUT_FILENO, &rc, line_length);
-		pfasta_record_free(&pr);
-		pfasta_record_free(&rc);
+		// the name and sequence are only borrowed
+		rc.name = pr.name;
+		rc.name_length = pr.name_length;
+		rc.sequence = pr.sequence;
+		rc.sequence_length = pr.sequence_length;
+		if (pfasta_write(out, &rc)) {
+			errx(1, "error writing: %s", out->errstr);
+		}
+		rc.name = rc.sequence = NULL;
 	}
 
+	pfasta_record_free(&pr);
+	pfasta_record_free(&rc);
+	pfasta_print_stats(file_name, &pp);
 	pfasta_free(&pp);
 	close(file_descriptor);
 }
 
-char *revcomp(const char *seq, size_t len) {
-	if (!seq || !len) return NULL;
-	char *rev = malloc(len + 1);
-	if (!rev) {
-		err(errno, "out of memory.");
-	}
-	rev[len] = '\0';
+void reserve(char **str, size_t *capacity, size_t required) {
+	if (required <= *capacity) return;
 
-	for (size_t k = 0; k < len; k++) {
-		unsigned char d = '!', c = seq[len - k - 1];
+	char *neu = my_reallocarray(*str, required, 1);
+	if (!neu) err(errno, "out of memory.");
+
+	*str = neu;
+	*capacity = required;
+}
+
+void complement_table(unsigned char *table) {
+	for (int k = 0; k < 256; k++) {
+		unsigned char d = '!', c = k;
 
 		if (c >= 'A') {
 			d = c ^= c & 2 ? 4 : 21;
 		}
 
-		rev[k] = d;
+		// PFASTA_REJECT would stop the parser
+		table[k] = d == PFASTA_REJECT ? '!' : d;
 	}
+}
 
-	return rev;
+void reverse(char *seq, size_t len) {
+	for (size_t k = 0; k < len / 2; k++) {
+		char c = seq[k];
+		seq[k] = seq[len - k - 1];
+		seq[len - k - 1] = c;
+	}
 }
 
 void usage(int exit_code) {
@@ -12,29 +12,39 @@
 #include "pfasta.h"
 
 static size_t line_length = 70;
+static struct pfasta_writer *out;
 
 void usage(int exit_code);
 void process(const char *file_name);
 
+/** Sequences are kept packed, with two bits per base. */
+struct packed_record {
+	char *name;
+	char *comment;
+	struct pfasta_packed sequence;
+};
+
+void print_record(const struct packed_record *pr);
+
 struct seq_vector {
-	struct pfasta_record *data;
+	struct packed_record *data;
 	size_t size;
 	size_t capacity;
 } sv;
 
 void sv_init() {
-	sv.data = malloc(4 * sizeof(struct pfasta_record));
+	sv.data = malloc(4 * sizeof(struct packed_record));
 	sv.size = 0;
 	sv.capacity = 4;
 	if (!sv.data) err(errno, "malloc failed");
 }
 
-void sv_emplace(struct pfasta_record pr) {
+void sv_emplace(struct packed_record pr) {
 	if (sv.size < sv.capacity) {
 		sv.data[sv.size++] = pr;
 	} else {
 		sv.data = my_reallocarray(sv.data, sv.capacity / 2,
-		                          3 * sizeof(struct pfasta_record));
+		                          3 * sizeof(struct packed_record));
 		if (!sv.data) err(errno, "realloc failed");
 		// reallocarray would return NULL, if mult would overflow
 		sv.capacity = (sv.capacity / 2) * 3;
@@ -44,13 +54,15 @@ void sv_emplace(struct pfasta_record pr) {
 
 void sv_free() {
 	for (size_t i = 0; i < sv.size; i++) {
-		pfasta_record_free(&sv.data[i]);
+		free(sv.data[i].name);
+		free(sv.data[i].comment);
+		pfasta_packed_free(&sv.data[i].sequence);
 	}
 	free(sv.data);
 }
 
 void sv_swap(size_t i, size_t j) {
-	struct pfasta_record temp = sv.data[i];
+	struct packed_record temp = sv.data[i];
 	sv.data[i] = sv.data[j];
 	sv.data[j] = temp;
 }
@@ -70,7 +82,6 @@ int main(int argc, char *argv[]) {
 			line_length = my_strtonum(optarg, 0, INT_MAX, &errstr);
 			if (errstr) errx(1, "line length is %s: %s", errstr, optarg);
 
-			if (!line_length) line_length = -1;
 			break;
 		}
 		case 's': {
@@ -86,6 +97,8 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	out = pfasta_stdout_writer(line_length);
+
 	argc -= optind, argv += optind;
 	if (argc == 0) {
 		if (!isatty(STDIN_FILENO)) {
@@ -111,7 +124,7 @@ int main(int argc, char *argv[]) {
 	}
 
 	for (size_t i = 0; i < sv.size; i++) {
-		pfasta_print(STDOUT_FILENO, &sv.data[i], line_length);
+		print_record(&sv.data[i]);
 	}
 
 	sv_free();
@@ -128,16 +141,54 @@ void process(const char *file_name) {
 	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
 
 	while (!pp.done) {
-		struct pfasta_record pr = pfasta_read(&pp);
+		pfasta_progress(file_name, &pp);
+		struct pfasta_view pv = pfasta_read_header(&pp);
+		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
+
+		struct packed_record pr = {0};
+		pr.name = strndup(pv.name.data, pv.name.length);
+		if (!pr.name) err(errno, "strndup failed");
+		if (pv.comment.data) {
+			pr.comment = strndup(pv.comment.data, pv.comment.length);
+			if (!pr.comment) err(errno, "strndup failed");
+		}
+
+		pfasta_read_packed(&pp, &pr.sequence);
 		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
 		sv_emplace(pr);
 	}
 
+	pfasta_print_stats(file_name, &pp);
 	pfasta_free(&pp);
 	close(file_descriptor);
 }
 
+void print_record(const struct packed_record *pr) {
+	struct pfasta_view pv = {
+	    .name = {pr->name, strlen(pr->name)},
+	    .comment = {pr->comment, pr->comment ? strlen(pr->comment) : 0},
+	};
+	if (pfasta_write_header(out, &pv)) {
+		errx(1, "error writing: %s", out->errstr);
+	}
+
+	// Unpack piecewise so that the plain sequence never exists as a whole.
+	static char chunk[1 << 16];
+	for (size_t i = 0; i < pr->sequence.length; i += sizeof(chunk)) {
+		size_t end = i + sizeof(chunk);
+		if (end > pr->sequence.length) end = pr->sequence.length;
+
+		pfasta_packed_unpack(&pr->sequence, i, end, chunk);
+		if (pfasta_write_chunk(out, chunk, end - i)) {
+			errx(1, "error writing: %s", out->errstr);
+		}
+	}
+	if (pfasta_write_end(out)) {
+		errx(1, "error writing: %s", out->errstr);
+	}
+}
+
 void usage(int exit_code) {
 	static const char str[] = {
 	    "Usage: shuffle [OPTIONS...] [FILE...]\n"
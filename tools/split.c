@@ -37,7 +37,6 @@ int main(int argc, char **argv) {
 			line_length = my_strtonum(optarg, 0, INT_MAX, &errstr);
 			if (errstr) errx(1, "line length is %s: %s", errstr, optarg);
 
-			if (!line_length) line_length = -1;
 			break;
 		}
 		case 's':
@@ -74,6 +73,7 @@ void process(const char *file_name) {
 	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
 
 	while (!pp.done) {
+		pfasta_progress(file_name, &pp);
 		struct pfasta_record pr = pfasta_read(&pp);
 		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
@@ -85,19 +85,24 @@ void process(const char *file_name) {
 			err(errno, "building output path failed");
 		}
 
-		FILE *output = fopen(out_file_name, append ? "a" : "w");
-		if (output == NULL) {
+		int flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+		int output = open(out_file_name, flags, 0666);
+		if (output < 0) {
 			err(errno, "couldn't open file %s", out_file_name);
 		}
 
-		int file_descriptor = fileno(output);
-		pfasta_print(file_descriptor, &pr, line_length);
+		struct pfasta_writer pw = pfasta_writer_init(output, line_length);
+		if (pfasta_write(&pw, &pr) || pfasta_writer_flush(&pw)) {
+			errx(1, "%s: %s", out_file_name, pw.errstr);
+		}
 
-		fclose(output);
+		pfasta_writer_free(&pw);
+		close(output);
 		free(out_file_name);
 		pfasta_record_free(&pr);
 	}
 
+	pfasta_print_stats(file_name, &pp);
 	pfasta_free(&pp);
 	close(file_descriptor);
 }
@@ -1,19 +1,40 @@
 #include <err.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "common.h"
 #include "pfasta.h"
 
-void usage(int exit_code);
+static size_t threads = 1;
+static int flags = 0;
+
+_Noreturn void usage(int exit_code);
 void process(const char *file_name);
+void process_parallel(const char *file_name, int file_descriptor);
 
 int main(int argc, char *argv[]) {
 	int c;
-	while ((c = getopt(argc, argv, "h")) != -1) {
-		usage(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+	while ((c = getopt(argc, argv, "hrt:")) != -1) {
+		switch (c) {
+		case 'h':
+			usage(EXIT_SUCCESS);
+		case 'r':
+			flags |= PFASTA_READAHEAD;
+			break;
+		case 't': {
+			const char *errstr;
+
+			threads = my_strtonum(optarg, 0, INT_MAX, &errstr);
+			if (errstr) errx(1, "number of threads is %s: %s", errstr, optarg);
+			break;
+		}
+		default:
+			usage(EXIT_FAILURE);
+		}
 	}
 
 	argc -= optind, argv += optind;
@@ -37,27 +58,54 @@ void process(const char *file_name) {
 	    strcmp(file_name, "-") == 0 ? STDIN_FILENO : open(file_name, O_RDONLY);
 	if (file_descriptor < 0) err(1, "%s", file_name);
 
+	if (threads != 1) {
+		process_parallel(file_name, file_descriptor);
+		close(file_descriptor);
+		return;
+	}
+
 	struct pfasta_parser pp = pfasta_init(file_descriptor);
 	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
+	if (pfasta_set_flags(&pp, flags)) err(1, "%s", file_name);
 
+	// Sequences are checked, but never copied.
 	while (!pp.done) {
-		struct pfasta_record pr = pfasta_read(&pp);
+		pfasta_progress(file_name, &pp);
+		pfasta_read_header(&pp);
 		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 
-		pfasta_record_free(&pr);
+		pfasta_skip_sequence(&pp);
+		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
 	}
 
+	pfasta_print_stats(file_name, &pp);
 	pfasta_free(&pp);
 	close(file_descriptor);
 }
 
+void process_parallel(const char *file_name, int file_descriptor) {
+	struct pfasta_parallel pp =
+	    pfasta_parallel_init(file_descriptor, threads, 0, flags);
+	if (pp.errstr) errx(1, "%s: %s", file_name, pp.errstr);
+
+	while (!pp.done) {
+		struct pfasta_record pr = pfasta_parallel_read(&pp);
+		if (pp.errstr) errx(2, "%s: %s", file_name, pp.errstr);
+		pfasta_record_free(&pr);
+	}
+
+	pfasta_parallel_free(&pp);
+}
+
 void usage(int exit_code) {
 	static const char str[] = {
-	    "Usage: validate [FILE...]\n"
+	    "Usage: validate [OPTIONS...] [FILE...]\n"
 	    "Verify that the input is a valid FASTA file.\n"
 	    "When FILE is '-' read from standard input.\n\n"
 	    "Options:\n"
-	    "  -h         Display help and exit\n" //
+	    "  -h         Display help and exit\n"
+	    "  -r         Read ahead on a separate thread\n"
+	    "  -t num     Use num threads; 0 for one per CPU (default: 1)\n" //
 	};
 
 	fprintf(exit_code == EXIT_SUCCESS ? stdout : stderr, str);